@@ -4,17 +4,91 @@
  *
  */
 
+#include <string.h>
 #include "circular_buffer.h"
 
+/**
+ * @brief Copies bytes out of the buffer storage, starting at a given index.
+ *
+ * At most two block copies are done: up to the end of the storage and then
+ * from its beginning. Indexes are not changed.
+ *
+ * @param buffer [IN]: Circular buffer to be copied from.
+ * @param index [IN]: Index of the first byte to copy (masked here).
+ * @param data [OUT]: Destination array.
+ * @param length [IN]: Quantity of bytes to copy. Must not exceed the used space.
+ */
+static void Circular_Buffer_Copy_Out(volatile circular_buffer_t * buffer, uint16_t index, uint8_t * data, uint16_t length)
+{
+    uint16_t chunk;
+
+    index &= buffer->mask;
+    chunk = buffer->mask + 1 - index;
+
+    if (chunk > length)
+        chunk = length;
+
+    memcpy(data, &buffer->data[index], chunk);
+    memcpy(data + chunk, &buffer->data[0], length - chunk);
+}
+
+/**
+ * @brief Searches a byte in the used part of the buffer, without copying it out.
+ *
+ * The two contiguous segments (until the end of the storage, then from its
+ * beginning) are scanned in place with memchr, which works a word at a time.
+ *
+ * @param buffer [IN]: Circular buffer to be searched.
+ * @param first [IN]: Snapshot of i_first.
+ * @param used [IN]: Snapshot of the used space.
+ * @param start [IN]: Offset (from first) where the search starts. Must not exceed used.
+ * @param byte [IN]: Byte to be searched.
+ * @retval uint16_t: Offset (from first) of the byte, or used if not found.
+ */
+static uint16_t Circular_Buffer_Scan(volatile circular_buffer_t * buffer, uint16_t first, uint16_t used, uint16_t start, uint8_t byte)
+{
+    uint16_t index = (first + start) & buffer->mask;
+    uint16_t length = used - start;
+    uint16_t chunk = buffer->mask + 1 - index;
+    const uint8_t * found;
+
+    if (chunk > length)
+        chunk = length;
+
+    found = memchr(&buffer->data[index], byte, chunk);
+    if (found != NULL)
+        return start + (uint16_t)(found - &buffer->data[index]);
+
+    found = memchr(&buffer->data[0], byte, length - chunk);
+    if (found != NULL)
+        return start + chunk + (uint16_t)(found - &buffer->data[0]);
+
+    return used;
+}
+
 /**
  * @brief Init variables of the circular buffer.
  *
+ * If size is not valid (see CIRCULAR_BUFFER_SIZE_IS_VALID), the buffer has no
+ * room: every write is refused.
+ *
  * @param buffer [IN]: Circular buffer to be initialized.
+ * @param storage [IN]: Storage array of the buffer (see CIRCULAR_BUFFER_STORAGE).
+ * @param size [IN]: Size (bytes) of the storage array. Must be a 2^N value.
+ *
+ * @retval buffer_status_e: BUFFER_OK, or BUFFER_ERROR if size is not valid.
  */
-void Circular_Buffer_Init(volatile circular_buffer_t * buffer)
+buffer_status_e Circular_Buffer_Init(volatile circular_buffer_t * buffer, uint8_t * storage, uint16_t size)
 {
+    uint8_t valid = CIRCULAR_BUFFER_SIZE_IS_VALID(size);
+
+    buffer->data = storage;
+    buffer->mask = valid ? (size - 1) : 0;
     buffer->i_first = 0;
     buffer->i_last = 0;
+    buffer->overflow = 0;
+
+    return valid ? BUFFER_OK : BUFFER_ERROR;
 }
 
 /**
@@ -26,7 +100,7 @@ void Circular_Buffer_Init(volatile circular_buffer_t * buffer)
  */
 uint8_t Circular_Buffer_Is_Empty(volatile circular_buffer_t * buffer)
 {
-    return (buffer->i_first == buffer->i_last);
+    return (((buffer->i_last - buffer->i_first) & buffer->mask) == 0);
 }
 
 /**
@@ -38,7 +112,7 @@ uint8_t Circular_Buffer_Is_Empty(volatile circular_buffer_t * buffer)
  */
 uint8_t Circular_Buffer_Is_Full(volatile circular_buffer_t * buffer)
 {
-    return (((buffer->i_last + 1) & CIRCULAR_BUFFER_MASK) == buffer->i_first);
+    return (((buffer->i_last - buffer->i_first) & buffer->mask) == buffer->mask);
 }
 
 /**
@@ -50,7 +124,7 @@ uint8_t Circular_Buffer_Is_Full(volatile circular_buffer_t * buffer)
  */
 uint16_t Circular_Buffer_Used_Space(volatile circular_buffer_t * buffer)
 {
-    return (buffer->i_last - buffer->i_first) & CIRCULAR_BUFFER_MASK;
+    return (buffer->i_last - buffer->i_first) & buffer->mask;
 }
 
 /**
@@ -62,7 +136,7 @@ uint16_t Circular_Buffer_Used_Space(volatile circular_buffer_t * buffer)
  */
 uint16_t Circular_Buffer_Available_Space(volatile circular_buffer_t * buffer)
 {
-    return (CIRCULAR_BUFFER_SIZE - Circular_Buffer_Used_Space(buffer) - 1);
+    return (buffer->mask - Circular_Buffer_Used_Space(buffer));
 }
 
 /**
@@ -72,7 +146,12 @@ uint16_t Circular_Buffer_Available_Space(volatile circular_buffer_t * buffer)
  */
 void Circular_Buffer_Flush(volatile circular_buffer_t * buffer)
 {
-    buffer->i_first = buffer->i_last;
+    uint16_t first;
+
+    do
+    {
+        first = buffer->i_first;
+    } while (!Circular_Buffer_Swap16(&buffer->i_first, first, buffer->i_last));
 }
 
 /**
@@ -85,13 +164,20 @@ void Circular_Buffer_Flush(volatile circular_buffer_t * buffer)
  */
 buffer_status_e Circular_Buffer_Write_Byte(volatile circular_buffer_t * buffer, uint8_t byte)
 {
-    uint16_t next = (buffer->i_last + 1) & CIRCULAR_BUFFER_MASK;
+    uint16_t mask = buffer->mask;
+    uint16_t last = buffer->i_last;
 
-    if (next == buffer->i_first)
+    if (((last - buffer->i_first) & mask) == mask)
         return BUFFER_FULL;
 
-    buffer->data[buffer->i_last] = byte;
-    buffer->i_last = next;
+    // Consumer must be done with the slot before it is overwritten
+    CIRCULAR_BUFFER_BARRIER();
+
+    buffer->data[last & mask] = byte;
+
+    // Data must be visible before the new i_last
+    CIRCULAR_BUFFER_BARRIER();
+    buffer->i_last = last + 1;
 
     return BUFFER_OK;
 }
@@ -106,18 +192,33 @@ buffer_status_e Circular_Buffer_Write_Byte(volatile circular_buffer_t * buffer,
  * @param length [IN]: length (quantity in bytes) of the data array.
  * @retval buffer_status_e: Operation status, returns if the buffer is
  * full or if the data could be saved.
- *
- * If length is greater than available space,
  */
 buffer_status_e Circular_Buffer_Write_Array(volatile circular_buffer_t * buffer, const uint8_t * data, uint16_t length)
 {
-    if(Circular_Buffer_Available_Space(buffer) < length)
+    uint16_t mask = buffer->mask;
+    uint16_t last = buffer->i_last;
+    uint16_t available = (buffer->i_first - last - 1) & mask;
+
+    if(available < length)
         return BUFFER_FULL;
 
-    for (uint16_t i = 0; i < length; i++)
-    {
-        Circular_Buffer_Write_Byte(buffer, data[i]);
-    }
+    if(length == 0)
+        return BUFFER_OK;
+
+    CIRCULAR_BUFFER_BARRIER();
+
+    // Up to two block copies: until the end of the storage, then from its beginning
+    uint16_t chunk = mask + 1 - (last & mask);
+
+    if (chunk > length)
+        chunk = length;
+
+    memcpy(&buffer->data[last & mask], data, chunk);
+    memcpy(&buffer->data[0], data + chunk, length - chunk);
+
+    // Publish all the bytes at once
+    CIRCULAR_BUFFER_BARRIER();
+    buffer->i_last = last + length;
 
     return BUFFER_OK;
 }
@@ -132,11 +233,27 @@ buffer_status_e Circular_Buffer_Write_Array(volatile circular_buffer_t * buffer,
  */
 buffer_status_e Circular_Buffer_Read_Byte(volatile circular_buffer_t * buffer, uint8_t * byte)
 {
-    if (buffer->i_first == buffer->i_last)
-        return BUFFER_EMPTY;
+    uint16_t mask = buffer->mask;
+    uint16_t first;
+    uint8_t data;
+
+    do
+    {
+        first = buffer->i_first;
+
+        if (((buffer->i_last - first) & mask) == 0)
+            return BUFFER_EMPTY;
+
+        // Data must not be read before the i_last that covers it
+        CIRCULAR_BUFFER_BARRIER();
+
+        data = buffer->data[first & mask];
 
-    *byte = buffer->data[buffer->i_first];
-    buffer->i_first = (buffer->i_first + 1) & CIRCULAR_BUFFER_MASK;
+        // Data must be read before the slot is released to the producer
+        CIRCULAR_BUFFER_BARRIER();
+    } while (!Circular_Buffer_Swap16(&buffer->i_first, first, first + 1));
+
+    *byte = data;
 
     return BUFFER_OK;
 }
@@ -151,24 +268,30 @@ buffer_status_e Circular_Buffer_Read_Byte(volatile circular_buffer_t * buffer, u
  */
 uint16_t Circular_Buffer_Read_Array(volatile circular_buffer_t * buffer, uint8_t * data, uint16_t max_length)
 {
-    uint16_t used_space = Circular_Buffer_Used_Space(buffer);
-    if (used_space > max_length)
-    {
-        for (uint16_t i = 0; i < max_length; i++)
-        {
-            Circular_Buffer_Read_Byte(buffer, &data[i]);
-        }
-        return max_length;
-    }
-    else
+    uint16_t mask = buffer->mask;
+    uint16_t first;
+    uint16_t length;
+
+    do
     {
-        for (uint16_t i = 0; i < used_space; i++)
-        {
-            Circular_Buffer_Read_Byte(buffer, &data[i]);
-        }
-        return used_space;
-    }
-    return BUFFER_OK;
+        first = buffer->i_first;
+        length = (buffer->i_last - first) & mask;
+
+        if (length > max_length)
+            length = max_length;
+
+        if (length == 0)
+            return 0;
+
+        CIRCULAR_BUFFER_BARRIER();
+
+        Circular_Buffer_Copy_Out(buffer, first, data, length);
+
+        // Release all the bytes at once
+        CIRCULAR_BUFFER_BARRIER();
+    } while (!Circular_Buffer_Swap16(&buffer->i_first, first, first + length));
+
+    return length;
 }
 
 /**
@@ -180,10 +303,24 @@ uint16_t Circular_Buffer_Read_Array(volatile circular_buffer_t * buffer, uint8_t
  */
 buffer_status_e Circular_Buffer_Peek_Byte(volatile circular_buffer_t * buffer, uint8_t * byte)
 {
-    if (Circular_Buffer_Is_Empty(buffer))
-        return BUFFER_EMPTY;
+    uint16_t mask = buffer->mask;
+    uint16_t first;
+
+    do
+    {
+        first = buffer->i_first;
+
+        if (((buffer->i_last - first) & mask) == 0)
+            return BUFFER_EMPTY;
+
+        CIRCULAR_BUFFER_BARRIER();
+
+        *byte = buffer->data[first & mask];
+
+        // Peek again if the byte was dropped while being copied
+        CIRCULAR_BUFFER_BARRIER();
+    } while (first != buffer->i_first);
 
-    *byte = buffer->data[buffer->i_first];
     return BUFFER_OK;
 }
 
@@ -197,34 +334,50 @@ buffer_status_e Circular_Buffer_Peek_Byte(volatile circular_buffer_t * buffer, u
  */
 uint16_t Circular_Buffer_Peek_Array(volatile circular_buffer_t * buffer, uint8_t * data, uint16_t max_length)
 {
-    uint16_t used_space = Circular_Buffer_Used_Space(buffer);
+    return Circular_Buffer_Peek_Array_Offset(buffer, 0, data, max_length);
+}
 
-    if(used_space == 0 || max_length == 0)
-    {
-        return 0;
-    }
-    else if (used_space > max_length)
-    {
-        uint16_t index = buffer->i_first;
+/**
+ * @brief Peeks multiple bytes from the buffer, skipping the first offset bytes
+ * (e.g. a message header). The bytes in buffer are not removed (non-destructive).
+ *
+ * @param buffer [IN]: Buffer to be peeked from.
+ * @param offset [IN]: Quantity of bytes (from the oldest one) to skip.
+ * @param data [OUT]: Saves the data peeked from the buffer.
+ * @param max_length [IN]: Max length (quantity in bytes) to peek.
+ * @retval uint16_t: Quantity of bytes successfully peeked.
+ */
+uint16_t Circular_Buffer_Peek_Array_Offset(volatile circular_buffer_t * buffer, uint16_t offset, uint8_t * data, uint16_t max_length)
+{
+    uint16_t mask = buffer->mask;
+    uint16_t first;
+    uint16_t length;
 
-        for (uint16_t i = 0; i < max_length; i++)
-        {
-            data[i] = buffer->data[index];
-            index = (index + 1) & CIRCULAR_BUFFER_MASK;
-        }
-        return max_length;
-    }
-    else
+    do
     {
-        uint16_t index = buffer->i_first;
+        first = buffer->i_first;
+        length = (buffer->i_last - first) & mask;
 
-        for (uint16_t i = 0; i < used_space; i++)
-        {
-            data[i] = buffer->data[index];
-            index = (index + 1) & CIRCULAR_BUFFER_MASK;
-        }
-        return used_space;
-    }
+        if (length <= offset)
+            return 0;
+
+        length -= offset;
+
+        if (length > max_length)
+            length = max_length;
+
+        if (length == 0)
+            return 0;
+
+        CIRCULAR_BUFFER_BARRIER();
+
+        Circular_Buffer_Copy_Out(buffer, first + offset, data, length);
+
+        // Peek again if bytes were dropped while being copied
+        CIRCULAR_BUFFER_BARRIER();
+    } while (first != buffer->i_first);
+
+    return length;
 }
 
 /**
@@ -237,9 +390,271 @@ uint16_t Circular_Buffer_Peek_Array(volatile circular_buffer_t * buffer, uint8_t
  */
 buffer_status_e Circular_Buffer_Peek_Last(volatile circular_buffer_t * buffer, uint8_t * byte)
 {
-    if (buffer->i_first == buffer->i_last)
+    uint16_t mask = buffer->mask;
+    uint16_t last = buffer->i_last;
+
+    if (((last - buffer->i_first) & mask) == 0)
         return BUFFER_EMPTY;
 
-    *byte = buffer->data[(buffer->i_last - 1) & CIRCULAR_BUFFER_MASK];
+    CIRCULAR_BUFFER_BARRIER();
+
+    *byte = buffer->data[(last - 1) & mask];
+    return BUFFER_OK;
+}
+
+/**
+ * @brief Gets the contiguous free region of the buffer, to be filled in place
+ * (e.g. by a DMA channel). Nothing is published until Circular_Buffer_Write_Commit.
+ *
+ * The region ends at the end of the storage, so after a commit reaching the
+ * wrap point a second acquire returns the rest of the free space.
+ *
+ * @param buffer [IN]: Circular buffer to be written to.
+ * @param data [OUT]: Pointer to the first free byte inside the buffer storage.
+ * @param length [OUT]: Quantity of contiguous bytes that can be written at data.
+ * @retval buffer_status_e: BUFFER_OK if length > 0, BUFFER_FULL if not.
+ */
+buffer_status_e Circular_Buffer_Write_Acquire(volatile circular_buffer_t * buffer, uint8_t ** data, uint16_t * length)
+{
+    uint16_t mask = buffer->mask;
+    uint16_t last = buffer->i_last;
+    uint16_t available = (buffer->i_first - last - 1) & mask;
+    uint16_t chunk = mask + 1 - (last & mask);
+
+    if (chunk > available)
+        chunk = available;
+
+    // Consumer must be done with the region before it is handed out
+    CIRCULAR_BUFFER_BARRIER();
+
+    *data = &buffer->data[last & mask];
+    *length = chunk;
+
+    return (chunk == 0) ? BUFFER_FULL : BUFFER_OK;
+}
+
+/**
+ * @brief Publishes bytes written in place after Circular_Buffer_Write_Acquire.
+ *
+ * @param buffer [IN]: Circular buffer that was written to.
+ * @param length [IN]: Quantity of bytes written. Must not exceed the acquired length.
+ * @retval buffer_status_e: BUFFER_OK if published, BUFFER_FULL if length
+ * is greater than the available space (nothing is published).
+ */
+buffer_status_e Circular_Buffer_Write_Commit(volatile circular_buffer_t * buffer, uint16_t length)
+{
+    uint16_t mask = buffer->mask;
+    uint16_t last = buffer->i_last;
+
+    if (((buffer->i_first - last - 1) & mask) < length)
+        return BUFFER_FULL;
+
+    // Data must be visible before the new i_last
+    CIRCULAR_BUFFER_BARRIER();
+    buffer->i_last = last + length;
+
+    return BUFFER_OK;
+}
+
+/**
+ * @brief Gets the contiguous region of the oldest bytes, to be read in place
+ * (e.g. by a DMA channel or Uart_Write_Array). The bytes are not removed until
+ * Circular_Buffer_Read_Consume.
+ *
+ * The region ends at the end of the storage, so after consuming up to the wrap
+ * point a second call returns the rest of the data.
+ *
+ * @param buffer [IN]: Circular buffer to be read from.
+ * @param data [OUT]: Pointer to the oldest byte inside the buffer storage.
+ * @param length [OUT]: Quantity of contiguous bytes that can be read at data.
+ * @retval buffer_status_e: BUFFER_OK if length > 0, BUFFER_EMPTY if not.
+ */
+buffer_status_e Circular_Buffer_Read_Peek_Span(volatile circular_buffer_t * buffer, const uint8_t ** data, uint16_t * length)
+{
+    uint16_t mask = buffer->mask;
+    uint16_t first = buffer->i_first;
+    uint16_t used = (buffer->i_last - first) & mask;
+    uint16_t chunk = mask + 1 - (first & mask);
+
+    if (chunk > used)
+        chunk = used;
+
+    // Data must not be read before the i_last that covers it
+    CIRCULAR_BUFFER_BARRIER();
+
+    *data = &buffer->data[first & mask];
+    *length = chunk;
+
+    return (chunk == 0) ? BUFFER_EMPTY : BUFFER_OK;
+}
+
+/**
+ * @brief Removes bytes read in place after Circular_Buffer_Read_Peek_Span.
+ *
+ * @param buffer [IN]: Circular buffer that was read from.
+ * @param length [IN]: Quantity of bytes to remove.
+ * @retval buffer_status_e: BUFFER_OK if removed, BUFFER_EMPTY if length is
+ * greater than the used space (nothing is removed).
+ */
+buffer_status_e Circular_Buffer_Read_Consume(volatile circular_buffer_t * buffer, uint16_t length)
+{
+    uint16_t mask = buffer->mask;
+    uint16_t first;
+
+    // Data must be read before the region is released to the producer
+    CIRCULAR_BUFFER_BARRIER();
+
+    do
+    {
+        first = buffer->i_first;
+
+        if (((buffer->i_last - first) & mask) < length)
+            return BUFFER_EMPTY;
+    } while (!Circular_Buffer_Swap16(&buffer->i_first, first, first + length));
+
     return BUFFER_OK;
 }
+
+/**
+ * @brief Writes a new data byte on a circular buffer, dropping the oldest byte
+ * if the buffer is full (overwrite-oldest policy). Runs in O(1).
+ *
+ * Producer side function. A concurrent consumer stays consistent: it either
+ * reads the dropped byte before it is dropped, or retries after it.
+ * Each dropped byte increments the overflow counter
+ * (see Circular_Buffer_Get_Overflow_Count).
+ *
+ * Zero-copy spans (Circular_Buffer_Read_Peek_Span) are not protected against
+ * this function; use the Read/Peek functions with lossy buffers.
+ *
+ * @param buffer [IN]: Circular buffer to receive the new data.
+ * @param byte [IN]: Data to be written.
+ * @retval buffer_status_e: BUFFER_OK if no data was lost, BUFFER_FULL if the
+ * oldest byte was dropped to make room. The new byte is always written.
+ */
+buffer_status_e Circular_Buffer_Write_Byte_Overwrite(volatile circular_buffer_t * buffer, uint8_t byte)
+{
+    buffer_status_e status = BUFFER_OK;
+    uint16_t mask = buffer->mask;
+    uint16_t last = buffer->i_last;
+    uint16_t first;
+
+    // If full, drop the oldest byte. The consumer may release it at the same time.
+    while (((last - (first = buffer->i_first)) & mask) == mask)
+    {
+        if (Circular_Buffer_Swap16(&buffer->i_first, first, first + 1))
+        {
+            buffer->overflow++;
+            status = BUFFER_FULL;
+            break;
+        }
+    }
+
+    // Consumer must be done with the slot before it is overwritten
+    CIRCULAR_BUFFER_BARRIER();
+
+    buffer->data[last & mask] = byte;
+
+    // Data must be visible before the new i_last
+    CIRCULAR_BUFFER_BARRIER();
+    buffer->i_last = last + 1;
+
+    return status;
+}
+
+/**
+ * @brief Get the quantity of bytes dropped by Circular_Buffer_Write_Byte_Overwrite
+ * since the buffer was initialized. The counter wraps around at 2^32.
+ *
+ * @param buffer [IN]: Circular buffer to be analyzed.
+ *
+ * @retval uint32_t quantity of dropped bytes.
+ */
+uint32_t Circular_Buffer_Get_Overflow_Count(volatile circular_buffer_t * buffer)
+{
+    return buffer->overflow;
+}
+
+/**
+ * @brief Searches a byte (e.g. a '\n' delimiter) in the buffer, in place. The
+ * bytes in buffer are not removed (non-destructive).
+ *
+ * Offsets are counted from the oldest byte. If not found, offset is set to the
+ * used space, so calling again with the same offset only scans the bytes
+ * received since the previous call. Reset offset to 0 after reading from
+ * the buffer.
+ *
+ * @param buffer [IN]: Circular buffer to be searched.
+ * @param byte [IN]: Byte to be searched.
+ * @param offset [IN/OUT]: IN: offset where the search starts (0 for the whole
+ * buffer). OUT: offset of the byte, or where the next search should resume.
+ * @retval buffer_status_e: BUFFER_OK if found, BUFFER_EMPTY if not.
+ */
+buffer_status_e Circular_Buffer_Find_Byte(volatile circular_buffer_t * buffer, uint8_t byte, uint16_t * offset)
+{
+    uint16_t first = buffer->i_first;
+    uint16_t used = (buffer->i_last - first) & buffer->mask;
+    uint16_t start = (*offset > used) ? used : *offset;
+
+    CIRCULAR_BUFFER_BARRIER();
+
+    *offset = Circular_Buffer_Scan(buffer, first, used, start, byte);
+
+    return (*offset < used) ? BUFFER_OK : BUFFER_EMPTY;
+}
+
+/**
+ * @brief Searches a byte sequence (e.g. "\r\n" or "OK\r\n") in the buffer, in
+ * place. The bytes in buffer are not removed (non-destructive).
+ *
+ * Works as Circular_Buffer_Find_Byte. If not found, offset is set so that a
+ * pattern partially received at the end of the buffer is found by the next call.
+ *
+ * @param buffer [IN]: Circular buffer to be searched.
+ * @param pattern [IN]: Byte sequence to be searched.
+ * @param length [IN]: Length (quantity in bytes) of the pattern.
+ * @param offset [IN/OUT]: IN: offset where the search starts (0 for the whole
+ * buffer). OUT: offset of the first byte of the pattern, or where the next
+ * search should resume.
+ * @retval buffer_status_e: BUFFER_OK if found, BUFFER_EMPTY if not.
+ */
+buffer_status_e Circular_Buffer_Find_Pattern(volatile circular_buffer_t * buffer, const uint8_t * pattern, uint16_t length, uint16_t * offset)
+{
+    uint16_t mask = buffer->mask;
+    uint16_t first = buffer->i_first;
+    uint16_t used = (buffer->i_last - first) & mask;
+    uint16_t start = (*offset > used) ? used : *offset;
+    uint16_t pos = start;
+
+    if (length == 0)
+        return BUFFER_EMPTY;
+
+    CIRCULAR_BUFFER_BARRIER();
+
+    while ((pos = Circular_Buffer_Scan(buffer, first, used, pos, pattern[0])) < used)
+    {
+        uint16_t i = 1;
+
+        if ((used - pos) < length)
+            break;
+
+        while ((i < length) && (buffer->data[(first + pos + i) & mask] == pattern[i]))
+            i++;
+
+        if (i == length)
+        {
+            *offset = pos;
+            return BUFFER_OK;
+        }
+
+        pos++;
+    }
+
+    // Resume where a partially received pattern may start
+    if ((used >= length) && ((used - length + 1) > start))
+        start = used - length + 1;
+
+    *offset = start;
+
+    return BUFFER_EMPTY;
+}
@@ -1,7 +1,31 @@
 /**
  * @file circular_buffer.h
  *
+ * @brief FIFO byte buffer.
  *
+ * Single-producer/single-consumer (SPSC): one context may write (e.g. an
+ * USARTx_IRQHandler) while another context reads (e.g. the main loop) without
+ * disabling interrupts. The producer only updates i_last and the consumer only
+ * updates i_first; each index is published after a memory barrier, so the other
+ * side never sees an index before the data it covers.
+ *
+ * The only exception is Circular_Buffer_Write_Byte_Overwrite, which moves i_first
+ * to drop the oldest byte. The consumer updates i_first with an exclusive
+ * access (LDREXH/STREXH) and retries if a byte was dropped meanwhile.
+ *
+ * The indexes are free-running 16 bits counters: they are only masked to access
+ * the storage, and the used space is (i_last - i_first) & mask. So i_first only
+ * gets back to a previous value after 65536 bytes are dropped, not after a
+ * multiple of the buffer size, and the consumer retry above cannot be fooled
+ * by a producer that wrapped the whole buffer during a copy.
+ *
+ * Producer side: Circular_Buffer_Write_*.
+ * Consumer side: Circular_Buffer_Read_*, Circular_Buffer_Peek_Byte,
+ * Circular_Buffer_Peek_Array, Circular_Buffer_Find_*, Circular_Buffer_Flush.
+ * Circular_Buffer_Init must not run concurrently with any other function.
+ *
+ * Each buffer uses an external storage array of 2^N bytes, see
+ * CIRCULAR_BUFFER_STORAGE.
  */
 
 #ifndef UTILS_CIRCULAR_BUFFER_H_
@@ -14,28 +38,128 @@ extern "C" {
 #include <stdint.h>
 
 /**
- * @brief Sets the size of the circular buffer storage vector. Can be changed if
- *  a larger amount of space is required. Must be 2^N value. Watch out for the RAM consumption.
+ * @brief Memory barrier used to publish the indexes. On Cortex-M it is a DMB,
+ *  which orders the data accesses against the index update. Other targets
+ *  (host builds) fall back to a full compiler/hardware barrier.
+ *
+ */
+#if defined(__arm__)
+#include "cmsis_compiler.h"
+#define CIRCULAR_BUFFER_BARRIER()   __DMB()
+#else
+#define CIRCULAR_BUFFER_BARRIER()   __sync_synchronize()
+#endif
+
+/**
+ * @brief Compare-and-swap of a 16 bits value, as a single exclusive access
+ *  (LDREXH/STREXH on Cortex-M). Used to update indexes that more than one
+ *  context may write.
+ *
+ * In a circular buffer, i_first is owned by the consumer, except when
+ * Circular_Buffer_Write_Byte_Overwrite drops the oldest byte. Updating i_first
+ * with this function makes it fail, instead of moving the index backwards,
+ * when the producer dropped data in the meantime.
+ *
+ * @param value [IN]: Value to be updated.
+ * @param expected [IN]: Value it must still have.
+ * @param desired [IN]: New value.
+ * @retval 1 if the value was updated, 0 if it no longer had the expected value.
+ */
+static inline uint8_t Circular_Buffer_Swap16(volatile uint16_t * value, uint16_t expected, uint16_t desired)
+{
+#if defined(__arm__)
+    do
+    {
+        if (__LDREXH(value) != expected)
+        {
+            __CLREX();
+            return 0;
+        }
+    } while (__STREXH(desired, value) != 0);
+
+    return 1;
+#else
+    return __sync_bool_compare_and_swap(value, expected, desired);
+#endif
+}
+
+/**
+ * @brief Compare-and-swap of a 32 bits value (LDREX/STREX on Cortex-M).
+ *  See Circular_Buffer_Swap16.
+ *
+ * @param value [IN]: Value to be updated.
+ * @param expected [IN]: Value it must still have.
+ * @param desired [IN]: New value.
+ * @retval 1 if the value was updated, 0 if it no longer had the expected value.
+ */
+static inline uint8_t Circular_Buffer_Swap32(volatile uint32_t * value, uint32_t expected, uint32_t desired)
+{
+#if defined(__arm__)
+    do
+    {
+        if (__LDREXW(value) != expected)
+        {
+            __CLREX();
+            return 0;
+        }
+    } while (__STREXW(desired, value) != 0);
+
+    return 1;
+#else
+    return __sync_bool_compare_and_swap(value, expected, desired);
+#endif
+}
+
+/**
+ * @brief Largest storage size of a circular buffer (indexes are 16 bits).
  *
  */
-#define CIRCULAR_BUFFER_SIZE    0x400       //1024
+#define CIRCULAR_BUFFER_MAX_SIZE    0x8000      //32768
 
 /**
- * @brief Bit mask used to avoid overflow of indexes. Should be changed
- *  according to CIRCULAR_BUFFER_SIZE.
+ * @brief Evaluates to 1 if size can be used as circular buffer storage size:
+ *  a 2^N value between 2 and CIRCULAR_BUFFER_MAX_SIZE.
  *
  */
-#define CIRCULAR_BUFFER_MASK    0x3FF
+#define CIRCULAR_BUFFER_SIZE_IS_VALID(size) \
+    (((size) >= 2U) && ((size) <= CIRCULAR_BUFFER_MAX_SIZE) && (((size) & ((size) - 1U)) == 0U))
+
+#ifdef __cplusplus
+#define CIRCULAR_BUFFER_STATIC_ASSERT(cond, msg)    static_assert(cond, msg)
+#else
+#define CIRCULAR_BUFFER_STATIC_ASSERT(cond, msg)    _Static_assert(cond, msg)
+#endif
+
+/**
+ * @brief Declares a static storage array for a circular buffer. The build fails
+ *  if size is not a 2^N value. Watch out for the RAM consumption.
+ *
+ * Usage:
+ *
+ *      CIRCULAR_BUFFER_STORAGE(rx_storage, 256);
+ *      static volatile circular_buffer_t rx_buffer;
+ *
+ *      Circular_Buffer_Init(&rx_buffer, rx_storage, sizeof(rx_storage));
+ *
+ * Usable space is size - 1 bytes.
+ */
+#define CIRCULAR_BUFFER_STORAGE(name, size) \
+    CIRCULAR_BUFFER_STATIC_ASSERT(CIRCULAR_BUFFER_SIZE_IS_VALID(size), \
+        "circular buffer size must be a power of two"); \
+    static uint8_t name[(size)]
 
 /**
  * @brief Struct definition of the Circular Buffer.
  *
+ * The storage is external to the struct, so each instance can have its own size.
  */
 typedef struct FIFO_Circular_Buffer
 {
-    uint8_t data[CIRCULAR_BUFFER_SIZE]; /**< Data Array */
-    uint16_t i_first;   /**< Index of the first position */
-    uint16_t i_last;    /**< Index of the last position */
+    uint8_t * data;     /**< Data Array (2^N bytes) */
+    uint16_t mask;      /**< Bit mask used to avoid overflow of indexes (size - 1) */
+    uint16_t i_first;   /**< Index of the first position (free-running, storage index is i_first & mask) */
+    uint16_t i_last;    /**< Index of the last position (free-running, storage index is i_last & mask) */
+    uint32_t overflow;  /**< Quantity of bytes dropped by the overwrite-oldest write */
 } circular_buffer_t ;
 
 /**
@@ -46,10 +170,11 @@ typedef enum STATUS_Circular_Buffer
 {
     BUFFER_OK,
     BUFFER_EMPTY,
-    BUFFER_FULL
+    BUFFER_FULL,
+    BUFFER_ERROR        /**< Invalid argument (e.g. message length or storage size not allowed) */
 } buffer_status_e;
 
-void Circular_Buffer_Init(volatile circular_buffer_t * buffer);
+buffer_status_e Circular_Buffer_Init(volatile circular_buffer_t * buffer, uint8_t * storage, uint16_t size);
 
 uint8_t  Circular_Buffer_Is_Empty(volatile circular_buffer_t * buffer);
 uint8_t  Circular_Buffer_Is_Full(volatile circular_buffer_t * buffer);
@@ -60,15 +185,28 @@ void Circular_Buffer_Flush(volatile circular_buffer_t * buffer);
 
 buffer_status_e Circular_Buffer_Write_Byte(volatile circular_buffer_t * buffer, uint8_t byte);
 buffer_status_e Circular_Buffer_Write_Array(volatile circular_buffer_t * buffer, const uint8_t * data, uint16_t length);
+buffer_status_e Circular_Buffer_Write_Byte_Overwrite(volatile circular_buffer_t * buffer, uint8_t byte);
+
+uint32_t Circular_Buffer_Get_Overflow_Count(volatile circular_buffer_t * buffer);
 
 buffer_status_e Circular_Buffer_Read_Byte(volatile circular_buffer_t * buffer, uint8_t * byte);
 uint16_t        Circular_Buffer_Read_Array(volatile circular_buffer_t * buffer, uint8_t * data, uint16_t max_length);
 
 buffer_status_e Circular_Buffer_Peek_Byte(volatile circular_buffer_t * buffer, uint8_t * byte);
 uint16_t        Circular_Buffer_Peek_Array(volatile circular_buffer_t * buffer, uint8_t * data, uint16_t max_length);
+uint16_t        Circular_Buffer_Peek_Array_Offset(volatile circular_buffer_t * buffer, uint16_t offset, uint8_t * data, uint16_t max_length);
 
 buffer_status_e Circular_Buffer_Peek_Last(volatile circular_buffer_t * buffer, uint8_t * byte);
 
+buffer_status_e Circular_Buffer_Find_Byte(volatile circular_buffer_t * buffer, uint8_t byte, uint16_t * offset);
+buffer_status_e Circular_Buffer_Find_Pattern(volatile circular_buffer_t * buffer, const uint8_t * pattern, uint16_t length, uint16_t * offset);
+
+buffer_status_e Circular_Buffer_Write_Acquire(volatile circular_buffer_t * buffer, uint8_t ** data, uint16_t * length);
+buffer_status_e Circular_Buffer_Write_Commit(volatile circular_buffer_t * buffer, uint16_t length);
+
+buffer_status_e Circular_Buffer_Read_Peek_Span(volatile circular_buffer_t * buffer, const uint8_t ** data, uint16_t * length);
+buffer_status_e Circular_Buffer_Read_Consume(volatile circular_buffer_t * buffer, uint16_t length);
+
 #ifdef __cplusplus
 }
 #endif
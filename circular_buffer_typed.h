@@ -0,0 +1,199 @@
+/**
+ * @file circular_buffer_typed.h
+ *
+ * @brief FIFO buffers of fixed-size elements (uint16_t, uint32_t or any struct).
+ *
+ * Same index logic and SPSC rules as circular_buffer_t (see circular_buffer.h),
+ * but each slot holds one element, so samples are stored and read with aligned
+ * word accesses instead of being split into bytes.
+ *
+ * A buffer type and its functions are generated with CIRCULAR_BUFFER_TYPED_DEFINE.
+ * The uint16_t and uint32_t versions are already defined below:
+ *
+ *      CIRCULAR_BUFFER_TYPED_STORAGE(adc_storage, uint16_t, 128);
+ *      static volatile circular_buffer_u16_t adc_buffer;
+ *
+ *      Circular_Buffer_U16_Init(&adc_buffer, adc_storage, 128);
+ *      Circular_Buffer_U16_Write(&adc_buffer, ADC1->DR);
+ *
+ * For a struct element:
+ *
+ *      CIRCULAR_BUFFER_TYPED_DEFINE(imu_buffer_t, Imu_Buffer, imu_sample_t)
+ *
+ * Overwrite-oldest writes are not available for typed buffers.
+ */
+
+#ifndef UTILS_CIRCULAR_BUFFER_TYPED_H_
+#define UTILS_CIRCULAR_BUFFER_TYPED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "circular_buffer.h"
+
+/**
+ * @brief Declares a static storage array of count elements for a typed buffer.
+ *  The build fails if count is not a 2^N value. Usable space is count - 1 elements.
+ *
+ */
+#define CIRCULAR_BUFFER_TYPED_STORAGE(name, type, count) \
+    CIRCULAR_BUFFER_STATIC_ASSERT(CIRCULAR_BUFFER_SIZE_IS_VALID(count), \
+        "circular buffer size must be a power of two"); \
+    static type name[(count)]
+
+/**
+ * @brief Generates a typed buffer: the struct buffer_type and the functions
+ *  prefix_Init, prefix_Is_Empty, prefix_Used_Space, prefix_Available_Space,
+ *  prefix_Flush, prefix_Write, prefix_Read, prefix_Peek, prefix_Write_Array
+ *  and prefix_Read_Array. Sizes and lengths are in elements.
+ *
+ * Init returns BUFFER_ERROR if count is not valid (see CIRCULAR_BUFFER_SIZE_IS_VALID),
+ * and the buffer then has no room. Write/Write_Array return BUFFER_FULL if there
+ * is no room (all-or-nothing),
+ * Read/Peek return BUFFER_EMPTY if there is no element, Read_Array returns the
+ * quantity of elements read.
+ *
+ * @param buffer_type Name of the generated struct type.
+ * @param prefix Prefix of the generated function names.
+ * @param type Element type.
+ */
+#define CIRCULAR_BUFFER_TYPED_DEFINE(buffer_type, prefix, type) \
+ \
+typedef struct \
+{ \
+    type * data;        /**< Data Array (2^N elements) */ \
+    uint16_t mask;      /**< Bit mask used to avoid overflow of indexes (count - 1) */ \
+    uint16_t i_first;   /**< Index of the first position */ \
+    uint16_t i_last;    /**< Index of the last position */ \
+} buffer_type; \
+ \
+static inline buffer_status_e prefix##_Init(volatile buffer_type * buffer, type * storage, uint16_t count) \
+{ \
+    uint8_t valid = CIRCULAR_BUFFER_SIZE_IS_VALID(count); \
+ \
+    buffer->data = storage; \
+    buffer->mask = valid ? (count - 1) : 0; \
+    buffer->i_first = 0; \
+    buffer->i_last = 0; \
+ \
+    return valid ? BUFFER_OK : BUFFER_ERROR; \
+} \
+ \
+static inline uint8_t prefix##_Is_Empty(volatile buffer_type * buffer) \
+{ \
+    return (buffer->i_first == buffer->i_last); \
+} \
+ \
+static inline uint16_t prefix##_Used_Space(volatile buffer_type * buffer) \
+{ \
+    return (buffer->i_last - buffer->i_first) & buffer->mask; \
+} \
+ \
+static inline uint16_t prefix##_Available_Space(volatile buffer_type * buffer) \
+{ \
+    return (buffer->i_first - buffer->i_last - 1) & buffer->mask; \
+} \
+ \
+static inline void prefix##_Flush(volatile buffer_type * buffer) \
+{ \
+    buffer->i_first = buffer->i_last; \
+} \
+ \
+static inline buffer_status_e prefix##_Write(volatile buffer_type * buffer, type value) \
+{ \
+    uint16_t last = buffer->i_last; \
+    uint16_t next = (last + 1) & buffer->mask; \
+ \
+    if (next == buffer->i_first) \
+        return BUFFER_FULL; \
+ \
+    CIRCULAR_BUFFER_BARRIER(); \
+    buffer->data[last] = value; \
+    CIRCULAR_BUFFER_BARRIER(); \
+    buffer->i_last = next; \
+ \
+    return BUFFER_OK; \
+} \
+ \
+static inline buffer_status_e prefix##_Read(volatile buffer_type * buffer, type * value) \
+{ \
+    uint16_t first = buffer->i_first; \
+ \
+    if (first == buffer->i_last) \
+        return BUFFER_EMPTY; \
+ \
+    CIRCULAR_BUFFER_BARRIER(); \
+    *value = buffer->data[first]; \
+    CIRCULAR_BUFFER_BARRIER(); \
+    buffer->i_first = (first + 1) & buffer->mask; \
+ \
+    return BUFFER_OK; \
+} \
+ \
+static inline buffer_status_e prefix##_Peek(volatile buffer_type * buffer, type * value) \
+{ \
+    uint16_t first = buffer->i_first; \
+ \
+    if (first == buffer->i_last) \
+        return BUFFER_EMPTY; \
+ \
+    CIRCULAR_BUFFER_BARRIER(); \
+    *value = buffer->data[first]; \
+ \
+    return BUFFER_OK; \
+} \
+ \
+static inline buffer_status_e prefix##_Write_Array(volatile buffer_type * buffer, const type * data, uint16_t length) \
+{ \
+    uint16_t mask = buffer->mask; \
+    uint16_t last = buffer->i_last; \
+    uint16_t chunk = mask + 1 - last; \
+ \
+    if (((buffer->i_first - last - 1) & mask) < length) \
+        return BUFFER_FULL; \
+ \
+    if (chunk > length) \
+        chunk = length; \
+ \
+    CIRCULAR_BUFFER_BARRIER(); \
+    memcpy(&buffer->data[last], data, chunk * sizeof(type)); \
+    memcpy(&buffer->data[0], data + chunk, (length - chunk) * sizeof(type)); \
+    CIRCULAR_BUFFER_BARRIER(); \
+    buffer->i_last = (last + length) & mask; \
+ \
+    return BUFFER_OK; \
+} \
+ \
+static inline uint16_t prefix##_Read_Array(volatile buffer_type * buffer, type * data, uint16_t max_length) \
+{ \
+    uint16_t mask = buffer->mask; \
+    uint16_t first = buffer->i_first; \
+    uint16_t length = (buffer->i_last - first) & mask; \
+    uint16_t chunk = mask + 1 - first; \
+ \
+    if (length > max_length) \
+        length = max_length; \
+ \
+    if (chunk > length) \
+        chunk = length; \
+ \
+    CIRCULAR_BUFFER_BARRIER(); \
+    memcpy(data, &buffer->data[first], chunk * sizeof(type)); \
+    memcpy(data + chunk, &buffer->data[0], (length - chunk) * sizeof(type)); \
+    CIRCULAR_BUFFER_BARRIER(); \
+    buffer->i_first = (first + length) & mask; \
+ \
+    return length; \
+}
+
+CIRCULAR_BUFFER_TYPED_DEFINE(circular_buffer_u16_t, Circular_Buffer_U16, uint16_t)
+CIRCULAR_BUFFER_TYPED_DEFINE(circular_buffer_u32_t, Circular_Buffer_U32, uint32_t)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTILS_CIRCULAR_BUFFER_TYPED_H_ */
@@ -1,9 +1,228 @@
 #include "message_buffer.h"
 
-void Message_Buffer_Init(volatile message_buffer_t * msg_buffer)
+#include <string.h>
+
+/*
+ * msg_indexes is a ring with the start index (header position) of the newest
+ * MESSAGE_INDEX_STACK_SIZE messages, addressed by message sequence number.
+ * stack_head is the sequence of the next message written (only the writer
+ * changes it) and read_seq the sequence of the oldest message (only the reader
+ * changes it). Messages older than the ones in msg_indexes are only reachable
+ * by walking the headers from i_first.
+ *
+ * Multi-producer writes (Message_Buffer_Write_Message_MP):
+ *  - mp_claim packs the reserve index (low 16 bits) and the sequence of the next
+ *    message (high 16 bits). A producer claims both with one LDREX/STREX.
+ *  - The producer copies header + payload to the claimed space, then sets the
+ *    commit flag of its slot (mp_commit[seq % MESSAGE_MP_SLOTS]) with the end index.
+ *  - Whoever holds mp_lock publishes the committed messages in claim order
+ *    (moves i_last, pushes the index, increments quant_msg). A producer that
+ *    finds the lock taken leaves its message to be published by the holder.
+ */
+
+CIRCULAR_BUFFER_STATIC_ASSERT(CIRCULAR_BUFFER_SIZE_IS_VALID(MESSAGE_INDEX_STACK_SIZE),
+    "MESSAGE_INDEX_STACK_SIZE must be a power of two");
+
+#define MESSAGE_MP_COMMITTED    0x8000
+
+static buffer_status_e Message_Buffer_Make_Header(volatile message_buffer_t * msg_buffer, uint16_t length, uint8_t *header, uint8_t *header_size)
 {
-    Circular_Buffer_Init(&msg_buffer->data);
+    switch (msg_buffer->header_mode)
+    {
+        case MESSAGE_HEADER_COMPACT:
+            if (length > MESSAGE_COMPACT_MAX_LENGTH)
+                return BUFFER_ERROR;
+
+            if (length < 0x80)
+            {
+                header[0] = (uint8_t)length;
+                *header_size = 1;
+            }
+            else
+            {
+                header[0] = (uint8_t)(0x80 | (length >> 8));
+                header[1] = (uint8_t)(length & 0xFF);
+                *header_size = 2;
+            }
+            break;
+
+        case MESSAGE_HEADER_NONE:
+            if (length != msg_buffer->record_size)
+                return BUFFER_ERROR;
+
+            *header_size = 0;
+            break;
+
+        default:
+            header[0] = (uint8_t)(length >> 8);
+            header[1] = (uint8_t)(length & 0xFF);
+            *header_size = 2;
+            break;
+    }
+
+    return BUFFER_OK;
+}
+
+static uint16_t Message_Buffer_Get_Length(volatile message_buffer_t * msg_buffer, uint16_t index, uint8_t *header_size)
+{
+    uint16_t mask = msg_buffer->data.mask;
+    uint8_t first_byte = msg_buffer->data.data[index & mask];
+
+    switch (msg_buffer->header_mode)
+    {
+        case MESSAGE_HEADER_COMPACT:
+            if (0 == (first_byte & 0x80))
+            {
+                *header_size = 1;
+                return first_byte;
+            }
+            *header_size = 2;
+            return ((uint16_t)(first_byte & 0x7F) << 8) | msg_buffer->data.data[(index + 1) & mask];
+
+        case MESSAGE_HEADER_NONE:
+            *header_size = 0;
+            return msg_buffer->record_size;
+
+        default:
+            *header_size = 2;
+            return ((uint16_t)first_byte << 8) | msg_buffer->data.data[(index + 1) & mask];
+    }
+}
+
+static void Message_Buffer_Push_Index(volatile message_buffer_t * msg_buffer, uint16_t start)
+{
+    // Save the message start on the index stack (overwrites the oldest index)
+    msg_buffer->msg_indexes[msg_buffer->stack_head % MESSAGE_INDEX_STACK_SIZE] = start;
+    CIRCULAR_BUFFER_BARRIER();
+    msg_buffer->stack_head++;
+}
+
+static void Message_Buffer_Add_Quant(volatile message_buffer_t * msg_buffer, uint16_t delta)
+{
+    uint16_t quant_msg;
+
+    // quant_msg is changed by both sides (and by several producers)
+    do
+    {
+        quant_msg = msg_buffer->quant_msg;
+    } while (!Circular_Buffer_Swap16(&msg_buffer->quant_msg, quant_msg, quant_msg + delta));
+}
+
+static uint16_t Message_Buffer_Locate(volatile message_buffer_t * msg_buffer, uint16_t n)
+{
+    uint16_t seq = msg_buffer->read_seq + n;
+    uint16_t index;
+    uint8_t header_size;
+
+    if ((uint16_t)(msg_buffer->stack_head - seq) <= MESSAGE_INDEX_STACK_SIZE)
+    {
+        // O(1): message is on the index stack, unless a writer overwrote it meanwhile
+        index = msg_buffer->msg_indexes[seq % MESSAGE_INDEX_STACK_SIZE];
+        CIRCULAR_BUFFER_BARRIER();
+        if ((uint16_t)(msg_buffer->stack_head - seq) <= MESSAGE_INDEX_STACK_SIZE)
+            return index;
+    }
+
+    // Older than the index stack: walk the headers from the first message
+    index = msg_buffer->data.i_first;
+    for (uint16_t i = 0; i < n; i++)
+    {
+        uint16_t size = Message_Buffer_Get_Length(msg_buffer, index, &header_size);
+        index = (index + header_size + size) & msg_buffer->data.mask;
+    }
+
+    return index;
+}
+
+static void Message_Buffer_Copy_In(volatile message_buffer_t * msg_buffer, uint16_t index, const uint8_t *data, uint16_t length)
+{
+    uint16_t mask = msg_buffer->data.mask;
+    uint16_t chunk;
+
+    index &= mask;
+    chunk = mask + 1 - index;
+
+    if (chunk > length)
+        chunk = length;
+
+    memcpy(&msg_buffer->data.data[index], data, chunk);
+    memcpy(&msg_buffer->data.data[0], data + chunk, length - chunk);
+}
+
+static void Message_Buffer_MP_Publish(volatile message_buffer_t * msg_buffer)
+{
+    volatile uint16_t *commit;
+
+    do
+    {
+        // Somebody else is publishing: it also publishes our message
+        if (!Circular_Buffer_Swap16(&msg_buffer->mp_lock, 0, 1))
+            return;
+
+        // Publish the committed messages in claim order
+        commit = &msg_buffer->mp_commit[msg_buffer->mp_publish_seq % MESSAGE_MP_SLOTS];
+        while (*commit & MESSAGE_MP_COMMITTED)
+        {
+            uint16_t end = *commit & ~MESSAGE_MP_COMMITTED;
+
+            *commit = 0;
+            Message_Buffer_Push_Index(msg_buffer, msg_buffer->data.i_last);
+            CIRCULAR_BUFFER_BARRIER();
+            msg_buffer->data.i_last = end;
+            Message_Buffer_Add_Quant(msg_buffer, 1);
+            CIRCULAR_BUFFER_BARRIER();
+            msg_buffer->mp_publish_seq++;
+
+            commit = &msg_buffer->mp_commit[msg_buffer->mp_publish_seq % MESSAGE_MP_SLOTS];
+        }
+
+        CIRCULAR_BUFFER_BARRIER();
+        msg_buffer->mp_lock = 0;
+        CIRCULAR_BUFFER_BARRIER();
+
+        // A message committed after the last check (while the lock was held) would be left behind
+    } while (*commit & MESSAGE_MP_COMMITTED);
+}
+
+static void Message_Buffer_Copy_Payload(volatile message_buffer_t * msg_buffer, uint16_t index, uint8_t header_size, uint8_t *message, uint16_t length)
+{
+    uint16_t offset = (index + header_size - msg_buffer->data.i_first) & msg_buffer->data.mask;
+
+    Circular_Buffer_Peek_Array_Offset(&msg_buffer->data, offset, message, length);
+}
+
+buffer_status_e Message_Buffer_Init(volatile message_buffer_t * msg_buffer, uint8_t * storage, uint16_t size)
+{
+    buffer_status_e status = Circular_Buffer_Init(&msg_buffer->data, storage, size);
+
     msg_buffer->quant_msg = 0;
+    msg_buffer->stack_head = 0;
+    msg_buffer->read_seq = 0;
+    msg_buffer->header_mode = MESSAGE_HEADER_FIXED;
+    msg_buffer->record_size = 0;
+    msg_buffer->reserve_pending = 0;
+    msg_buffer->reserve_length = 0;
+    msg_buffer->reserve_header_size = 0;
+    msg_buffer->mp_claim = 0;
+    msg_buffer->mp_publish_seq = 0;
+    msg_buffer->mp_lock = 0;
+    for (uint8_t i = 0; i < MESSAGE_MP_SLOTS; i++)
+        msg_buffer->mp_commit[i] = 0;
+
+    return status;
+}
+
+buffer_status_e Message_Buffer_Set_Header_Mode(volatile message_buffer_t * msg_buffer, message_header_mode_e mode, uint16_t record_size)
+{
+    // The reserved message header was made with the current mode
+    if (msg_buffer->reserve_pending)
+        return BUFFER_ERROR;
+
+    Message_Buffer_Flush(msg_buffer);
+    msg_buffer->header_mode = mode;
+    msg_buffer->record_size = record_size;
+
+    return BUFFER_OK;
 }
 
 uint8_t Message_Buffer_Is_Empty(volatile message_buffer_t * msg_buffer)
@@ -28,57 +247,255 @@ uint16_t Message_Buffer_Quant_Msg(volatile message_buffer_t *msg_buffer)
 
 void Message_Buffer_Flush(volatile message_buffer_t * msg_buffer)
 {
-    Circular_Buffer_Flush(&msg_buffer->data);
-    msg_buffer->quant_msg = 0;
+    uint16_t quant_msg = msg_buffer->quant_msg;
+    uint16_t index;
+    uint16_t length;
+    uint8_t header_size;
+
+    if (quant_msg == 0)
+        return;
+
+    // Drop only the messages counted now: a producer may be publishing more
+    index = Message_Buffer_Locate(msg_buffer, quant_msg - 1);
+    length = Message_Buffer_Get_Length(msg_buffer, index, &header_size);
+    index = (index + header_size + length) & msg_buffer->data.mask;
+
+    Circular_Buffer_Read_Consume(&msg_buffer->data, (index - msg_buffer->data.i_first) & msg_buffer->data.mask);
+    Message_Buffer_Add_Quant(msg_buffer, -quant_msg);
+    msg_buffer->read_seq += quant_msg;
 }
 
 buffer_status_e Message_Buffer_Write_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t length)
 {
-    uint16_t required_space = length + 2; // 2 bytes para o tamanho
-    if (Circular_Buffer_Available_Space(&msg_buffer->data) < required_space)
+    uint8_t size_header[2];
+    uint8_t header_size;
+
+    // The reserved space starts at i_last
+    if (msg_buffer->reserve_pending)
+        return BUFFER_ERROR;
+
+    if (Message_Buffer_Make_Header(msg_buffer, length, size_header, &header_size) != BUFFER_OK)
+        return BUFFER_ERROR;
+
+    if (Circular_Buffer_Available_Space(&msg_buffer->data) < (uint32_t)length + header_size)
         return BUFFER_FULL;
 
-    uint8_t size_header[2] = { (uint8_t)(length >> 8), (uint8_t)(length & 0xFF) };
+    uint16_t start = msg_buffer->data.i_last;
 
-    if (Circular_Buffer_Write_Array(&msg_buffer->data, size_header, 2) != BUFFER_OK)
+    if (Circular_Buffer_Write_Array(&msg_buffer->data, size_header, header_size) != BUFFER_OK)
         return BUFFER_FULL;
 
     if (Circular_Buffer_Write_Array(&msg_buffer->data, message, length) != BUFFER_OK)
     {
         // rollback do header
-        msg_buffer->data.i_last = (msg_buffer->data.i_last - 2) & CIRCULAR_BUFFER_MASK;
+        msg_buffer->data.i_last = (msg_buffer->data.i_last - header_size) & msg_buffer->data.mask;
         return BUFFER_FULL;
     }
 
-    msg_buffer->quant_msg++;
+    Message_Buffer_Push_Index(msg_buffer, start);
+
+    Message_Buffer_Add_Quant(msg_buffer, 1);
     return BUFFER_OK;
 }
 
-buffer_status_e Message_Buffer_Read_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t *length)
+buffer_status_e Message_Buffer_Write_Message_MP(volatile message_buffer_t *msg_buffer, const uint8_t *message, uint16_t length)
 {
+    uint16_t mask = msg_buffer->data.mask;
     uint8_t size_header[2];
+    uint8_t header_size;
+    uint32_t claim;
+    uint16_t start;
+    uint16_t end;
+    uint16_t seq;
+
+    if (Message_Buffer_Make_Header(msg_buffer, length, size_header, &header_size) != BUFFER_OK)
+        return BUFFER_ERROR;
+
+    // Claim the space and a commit slot (retried if another producer claimed first)
+    do
+    {
+        claim = msg_buffer->mp_claim;
+        start = (uint16_t)claim;
+        seq = (uint16_t)(claim >> 16);
+
+        if (((msg_buffer->data.i_first - start - 1) & mask) < (uint32_t)length + header_size)
+            return BUFFER_FULL;
+
+        if ((uint16_t)(seq - msg_buffer->mp_publish_seq) >= MESSAGE_MP_SLOTS)
+            return BUFFER_FULL;
+
+        end = (start + header_size + length) & mask;
+    } while (!Circular_Buffer_Swap32(&msg_buffer->mp_claim, claim, ((uint32_t)(uint16_t)(seq + 1) << 16) | end));
+
+    CIRCULAR_BUFFER_BARRIER();
+    Message_Buffer_Copy_In(msg_buffer, start, size_header, header_size);
+    Message_Buffer_Copy_In(msg_buffer, start + header_size, message, length);
+
+    // Message is complete: mark its slot, then try to publish it
+    CIRCULAR_BUFFER_BARRIER();
+    msg_buffer->mp_commit[seq % MESSAGE_MP_SLOTS] = MESSAGE_MP_COMMITTED | end;
+    CIRCULAR_BUFFER_BARRIER();
+
+    Message_Buffer_MP_Publish(msg_buffer);
+
+    return BUFFER_OK;
+}
+
+buffer_status_e Message_Buffer_Read_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t *length)
+{
+    uint8_t header_size;
 
     if (msg_buffer->quant_msg == 0)
         return BUFFER_EMPTY;
 
-    if (Circular_Buffer_Peek_Array(&msg_buffer->data, size_header, 2) < 2)
+    *length = Message_Buffer_Get_Length(msg_buffer, msg_buffer->data.i_first, &header_size);
+
+    if (Circular_Buffer_Used_Space(&msg_buffer->data) < ((uint32_t)*length + header_size))
+        return BUFFER_EMPTY;
+
+    // Save the message data, then remove header + data at once
+    Circular_Buffer_Peek_Array_Offset(&msg_buffer->data, header_size, message, *length);
+    Circular_Buffer_Read_Consume(&msg_buffer->data, header_size + *length);
+    Message_Buffer_Add_Quant(msg_buffer, -1);
+    msg_buffer->read_seq++;
+
+    return BUFFER_OK;
+}
+
+buffer_status_e Message_Buffer_Drop_Message(volatile message_buffer_t *msg_buffer)
+{
+    uint16_t length;
+    uint8_t header_size;
+
+    if (msg_buffer->quant_msg == 0)
         return BUFFER_EMPTY;
 
-    *length = ((uint16_t)size_header[0] << 8) | size_header[1];
+    length = Message_Buffer_Get_Length(msg_buffer, msg_buffer->data.i_first, &header_size);
 
-    if (Circular_Buffer_Used_Space(&msg_buffer->data) < (*length + 2))
+    if (Circular_Buffer_Used_Space(&msg_buffer->data) < ((uint32_t)length + header_size))
         return BUFFER_EMPTY;
 
-    // Flush the message header:
-    Circular_Buffer_Read_Array(&msg_buffer->data, size_header, 2);
+    Circular_Buffer_Read_Consume(&msg_buffer->data, header_size + length);
+    Message_Buffer_Add_Quant(msg_buffer, -1);
+    msg_buffer->read_seq++;
+
+    return BUFFER_OK;
+}
+
+uint16_t Message_Buffer_Read_Batch(volatile message_buffer_t *msg_buffer, uint8_t *messages, uint16_t max_bytes, uint16_t *lengths, uint16_t max_msgs)
+{
+    uint16_t quant_msg = msg_buffer->quant_msg;
+    uint16_t index = msg_buffer->data.i_first;
+    uint16_t used = Circular_Buffer_Used_Space(&msg_buffer->data);
+    uint16_t offset = 0;    // bytes (headers + payloads) of the messages gathered
+    uint16_t total = 0;     // payload bytes gathered
+    uint16_t count = 0;
+    uint8_t header_size;
+
+    while ((count < quant_msg) && (count < max_msgs))
+    {
+        uint16_t length = Message_Buffer_Get_Length(msg_buffer, index, &header_size);
+
+        if ((uint32_t)total + length > max_bytes)
+            break;
+
+        if ((uint32_t)offset + header_size + length > used)
+            break;
 
-    // Save the message data
-    Circular_Buffer_Read_Array(&msg_buffer->data, message, *length);
-    msg_buffer->quant_msg--;
+        Circular_Buffer_Peek_Array_Offset(&msg_buffer->data, offset + header_size, &messages[total], length);
+        lengths[count] = length;
+
+        total += length;
+        offset += header_size + length;
+        index = (index + header_size + length) & msg_buffer->data.mask;
+        count++;
+    }
+
+    if (count == 0)
+        return 0;
+
+    // Remove all the messages gathered at once
+    Circular_Buffer_Read_Consume(&msg_buffer->data, offset);
+    Message_Buffer_Add_Quant(msg_buffer, -count);
+    msg_buffer->read_seq += count;
+
+    return count;
+}
+
+buffer_status_e Message_Buffer_Reserve(volatile message_buffer_t *msg_buffer, uint16_t length, uint8_t **part1, uint16_t *length1, uint8_t **part2, uint16_t *length2)
+{
+    uint16_t mask = msg_buffer->data.mask;
+    uint8_t size_header[2] = {0, 0};
+    uint8_t header_size;
+    uint16_t start;
+    uint16_t chunk;
+
+    if (msg_buffer->reserve_pending)
+        return BUFFER_ERROR;
+
+    if (Message_Buffer_Make_Header(msg_buffer, length, size_header, &header_size) != BUFFER_OK)
+        return BUFFER_ERROR;
+
+    if (Circular_Buffer_Available_Space(&msg_buffer->data) < (uint32_t)length + header_size)
+        return BUFFER_FULL;
+
+    // Payload goes after the header, which is only written on commit
+    start = (msg_buffer->data.i_last + header_size) & mask;
+    chunk = mask + 1 - start;
+
+    if (chunk > length)
+        chunk = length;
+
+    *part1 = &msg_buffer->data.data[start];
+    *length1 = chunk;
+    *part2 = &msg_buffer->data.data[0];
+    *length2 = length - chunk;
+
+    // Commit writes this header, even if the header mode is changed meanwhile
+    msg_buffer->reserve_header[0] = size_header[0];
+    msg_buffer->reserve_header[1] = size_header[1];
+    msg_buffer->reserve_header_size = header_size;
+    msg_buffer->reserve_length = length;
+    msg_buffer->reserve_pending = 1;
 
     return BUFFER_OK;
 }
 
+buffer_status_e Message_Buffer_Commit(volatile message_buffer_t *msg_buffer)
+{
+    uint16_t start = msg_buffer->data.i_last;
+    uint16_t length = msg_buffer->reserve_length;
+    uint8_t header_size = msg_buffer->reserve_header_size;
+    uint8_t size_header[2];
+
+    if (!msg_buffer->reserve_pending)
+        return BUFFER_ERROR;
+
+    size_header[0] = msg_buffer->reserve_header[0];
+    size_header[1] = msg_buffer->reserve_header[1];
+
+    Message_Buffer_Copy_In(msg_buffer, start, size_header, header_size);
+
+    // Header and payload are published by a single index update
+    if (Circular_Buffer_Write_Commit(&msg_buffer->data, header_size + length) != BUFFER_OK)
+    {
+        msg_buffer->reserve_pending = 0;
+        return BUFFER_FULL;
+    }
+
+    msg_buffer->reserve_pending = 0;
+
+    Message_Buffer_Push_Index(msg_buffer, start);
+
+    Message_Buffer_Add_Quant(msg_buffer, 1);
+    return BUFFER_OK;
+}
+
+void Message_Buffer_Abort(volatile message_buffer_t *msg_buffer)
+{
+    msg_buffer->reserve_pending = 0;
+}
+
 // // essa versao da funcao retorna a mensagem junto com os 2 bytes de header do tamanho da mensagem.
 //buffer_status_e Message_Buffer_Peek_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t *length)
 //{
@@ -103,76 +520,76 @@ buffer_status_e Message_Buffer_Read_Message(volatile message_buffer_t *msg_buffe
 
 buffer_status_e Message_Buffer_Peek_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t *length)
 {
-    if (msg_buffer->quant_msg == 0)
-        return BUFFER_EMPTY;
+    uint8_t header_size;
 
-    uint8_t size_header[2];
-
-    // Lê os dois bytes iniciais (tamanho da mensagem)
-    if (Circular_Buffer_Peek_Array(&msg_buffer->data, size_header, 2) < 2)
+    if (msg_buffer->quant_msg == 0)
         return BUFFER_EMPTY;
 
-    *length = ((uint16_t)size_header[0] << 8) | size_header[1];
+    // Lê o header (tamanho da mensagem)
+    *length = Message_Buffer_Get_Length(msg_buffer, msg_buffer->data.i_first, &header_size);
 
     // Verifica se há espaço suficiente para o payload
-    if (Circular_Buffer_Used_Space(&msg_buffer->data) < (*length + 2))
+    if (Circular_Buffer_Used_Space(&msg_buffer->data) < ((uint32_t)*length + header_size))
         return BUFFER_EMPTY;
 
-    // Cria buffer temporário para header + payload
-    uint8_t temp[2 + *length];
-
-    // Copia tudo (header + payload) para temp
-    if (Circular_Buffer_Peek_Array(&msg_buffer->data, temp, 2 + *length) < 2 + *length)
+    // Copia apenas o payload (sem header) direto do buffer circular
+    if (Circular_Buffer_Peek_Array_Offset(&msg_buffer->data, header_size, message, *length) < *length)
         return BUFFER_EMPTY;
 
-    // Copia apenas o payload para o buffer fornecido
-    for (uint16_t i = 0; i < *length; i++)
-        message[i] = temp[2 + i];
-
     return BUFFER_OK;
 }
 
-// TODO verificar essa funcao
-buffer_status_e Message_Buffer_Peek_Last_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t *length)
+buffer_status_e Message_Buffer_Peek_Message_Spans(volatile message_buffer_t *msg_buffer, const uint8_t **part1, uint16_t *length1, const uint8_t **part2, uint16_t *length2)
 {
+    uint16_t mask = msg_buffer->data.mask;
+    uint16_t first = msg_buffer->data.i_first;
+    uint16_t length;
+    uint16_t start;
+    uint16_t chunk;
+    uint8_t header_size;
+
     if (msg_buffer->quant_msg == 0)
         return BUFFER_EMPTY;
 
-    circular_buffer_t *buf = (circular_buffer_t *)&msg_buffer->data;
-    uint16_t idx = buf->i_first;
-    uint16_t used = Circular_Buffer_Used_Space(buf);
-    uint16_t count = 0;
-    uint16_t last_msg_pos = 0;
-    uint16_t msg_len = 0;
+    length = Message_Buffer_Get_Length(msg_buffer, first, &header_size);
 
-    while (count + 2 <= used && last_msg_pos < used)
-    {
-        // Lê o header de 2 bytes
-        uint8_t size_high = buf->data[(idx + 0) & CIRCULAR_BUFFER_MASK];
-        uint8_t size_low  = buf->data[(idx + 1) & CIRCULAR_BUFFER_MASK];
-        uint16_t size = ((uint16_t)size_high << 8) | size_low;
+    if (Circular_Buffer_Used_Space(&msg_buffer->data) < ((uint32_t)length + header_size))
+        return BUFFER_EMPTY;
 
-        if (count + 2 + size > used)
-            break;  // Mensagem incompleta ou corrompida
+    // Payload starts after the header and may wrap around the end of the storage
+    start = (first + header_size) & mask;
+    chunk = mask + 1 - start;
 
-        last_msg_pos = idx;     // Guarda início da última mensagem válida
-        msg_len = size;
+    if (chunk > length)
+        chunk = length;
 
-        // Avança para a próxima mensagem
-        idx = (idx + 2 + size) & CIRCULAR_BUFFER_MASK;
-        count += 2 + size;
-    }
+    *part1 = &msg_buffer->data.data[start];
+    *length1 = chunk;
+    *part2 = &msg_buffer->data.data[0];
+    *length2 = length - chunk;
+
+    return BUFFER_OK;
+}
 
-    if (msg_len == 0)
+buffer_status_e Message_Buffer_Peek_Last_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t *length)
+{
+    return Message_Buffer_Peek_Nth_Message(msg_buffer, msg_buffer->quant_msg - 1, message, length);
+}
+
+buffer_status_e Message_Buffer_Peek_Nth_Message(volatile message_buffer_t *msg_buffer, uint16_t n, uint8_t *message, uint16_t *length)
+{
+    uint16_t index;
+    uint8_t header_size;
+
+    if (n >= msg_buffer->quant_msg)
         return BUFFER_EMPTY;
 
-    *length = msg_len;
+    index = Message_Buffer_Locate(msg_buffer, n);
 
-    // Copia apenas os dados da última mensagem (sem header)
-    for (uint16_t i = 0; i < msg_len; i++)
-    {
-        message[i] = buf->data[(last_msg_pos + 2 + i) & CIRCULAR_BUFFER_MASK];
-    }
+    *length = Message_Buffer_Get_Length(msg_buffer, index, &header_size);
+
+    // Copia apenas os dados da mensagem (sem header)
+    Message_Buffer_Copy_Payload(msg_buffer, index, header_size, message, *length);
 
     return BUFFER_OK;
 }
@@ -5,6 +5,11 @@
  *
  * Its similar to circular_buffer module, but this is more useful to use
  * with USART transmission messages, by creating a FIFO message buffer.
+ *
+ * Same SPSC rules as circular_buffer: one writer (Write_Message, Reserve/Commit)
+ * and one reader (Read_*, Peek_*, Flush). When several ISRs write to the same
+ * buffer, all of them must use Message_Buffer_Write_Message_MP instead, and the
+ * reader must not preempt the writers (e.g. read from the main loop).
  */
 
 #ifndef UTILS_MESSAGE_BUFFER_H_
@@ -17,7 +22,41 @@ extern "C" {
 #include <stdint.h>
 #include "circular_buffer.h"
 
+/**
+ * @brief Quantity of newest messages whose start index is kept, giving O(1)
+ *  access to them (Message_Buffer_Peek_Last_Message, Message_Buffer_Peek_Nth_Message).
+ *  Must be a 2^N value.
+ *
+ */
+#ifndef MESSAGE_INDEX_STACK_SIZE
 #define MESSAGE_INDEX_STACK_SIZE 64  // Ajuste conforme necessário
+#endif
+
+/**
+ * @brief Largest message length in MESSAGE_HEADER_COMPACT mode.
+ *
+ */
+#define MESSAGE_COMPACT_MAX_LENGTH  0x7FFF
+
+/**
+ * @brief Quantity of messages that can be claimed by Message_Buffer_Write_Message_MP
+ *  and not yet published, i.e. how many producers can be writing at the same time.
+ *
+ */
+#ifndef MESSAGE_MP_SLOTS
+#define MESSAGE_MP_SLOTS    8
+#endif
+
+/**
+ * @brief How the length of each message is stored in the buffer.
+ *
+ */
+typedef enum
+{
+    MESSAGE_HEADER_FIXED = 0,   /**< 2 bytes header (big-endian length). Default. */
+    MESSAGE_HEADER_COMPACT,     /**< 1 byte header for length < 128, 2 bytes otherwise (up to MESSAGE_COMPACT_MAX_LENGTH) */
+    MESSAGE_HEADER_NONE         /**< No header: every message has record_size bytes */
+} message_header_mode_e;
 
 /**
  * @brief Struct definition of the Circular Buffer.
@@ -28,8 +67,18 @@ typedef struct
     circular_buffer_t data;                         /**< Data Buffer */
     uint16_t quant_msg;                             /**< Quantity of messages */
     uint16_t msg_indexes[MESSAGE_INDEX_STACK_SIZE]; /**< Stack of message start indices */
-    uint16_t stack_head;                            /**< Points to where the next index will be stored */
-    uint16_t stack_size;                            /**< How many valid indices are in the stack */
+    uint16_t stack_head;                            /**< Sequence of the next message written (index stored at stack_head % size) */
+    uint16_t read_seq;                              /**< Sequence of the oldest message */
+    uint8_t header_mode;                            /**< Header encoding (message_header_mode_e) */
+    uint16_t record_size;                           /**< Message length in MESSAGE_HEADER_NONE mode */
+    uint8_t reserve_pending;                        /**< 1 between Message_Buffer_Reserve and Commit/Abort */
+    uint16_t reserve_length;                        /**< Length of the reserved message */
+    uint8_t reserve_header[2];                      /**< Header of the reserved message, written on commit */
+    uint8_t reserve_header_size;                    /**< Size of reserve_header (bytes) */
+    uint32_t mp_claim;                              /**< Multi-producer: reserve index (low half) and next sequence (high half) */
+    uint16_t mp_publish_seq;                        /**< Multi-producer: sequence of the next message to be published */
+    uint16_t mp_lock;                               /**< Multi-producer: 1 while a producer publishes messages */
+    uint16_t mp_commit[MESSAGE_MP_SLOTS];           /**< Multi-producer: end index of each written message, not yet published */
 } message_buffer_t;
 
 
@@ -37,8 +86,32 @@ typedef struct
  * @brief Init variables of the message buffer.
  *
  * @param msg_buffer [IN]: Message buffer to be initialized.
+ * @param storage [IN]: Storage array of the data buffer (see CIRCULAR_BUFFER_STORAGE).
+ * @param size [IN]: Size (bytes) of the storage array. Must be a 2^N value.
+ *
+ * @retval buffer_status_e: BUFFER_OK, or BUFFER_ERROR if size is not a 2^N value
+ * (the buffer then refuses every message).
+ */
+buffer_status_e Message_Buffer_Init(volatile message_buffer_t * msg_buffer, uint8_t * storage, uint16_t size);
+
+/**
+ * @brief Select how the message lengths are stored (default: MESSAGE_HEADER_FIXED).
+ *
+ * Small messages can use MESSAGE_HEADER_COMPACT (1 byte header below 128 bytes) or,
+ * if all messages have the same length, MESSAGE_HEADER_NONE (no header at all).
+ * The other functions work the same in every mode.
+ *
+ * Call it right after Message_Buffer_Init: the buffer is flushed. It is refused
+ * while a message is reserved (see Message_Buffer_Reserve).
+ *
+ * @param msg_buffer [IN]: Message buffer to be configured.
+ * @param mode [IN]: Header mode.
+ * @param record_size [IN]: Length of every message in MESSAGE_HEADER_NONE mode. Ignored in the other modes.
+ *
+ * @retval buffer_status_e: BUFFER_OK if the mode was set, BUFFER_ERROR if a
+ * message is reserved.
  */
-void Message_Buffer_Init(volatile message_buffer_t * msg_buffer);
+buffer_status_e Message_Buffer_Set_Header_Mode(volatile message_buffer_t * msg_buffer, message_header_mode_e mode, uint16_t record_size);
 
 /**
  * @brief Verify if the message buffer is empty.
@@ -52,7 +125,8 @@ uint8_t Message_Buffer_Is_Empty(volatile message_buffer_t * msg_buffer);
 /**
  * @brief Get amount of bytes saved on the buffer.
  *
- * Obs: for each message, there is two additional bytes that stores the message length.
+ * Obs: for each message, there is up to two additional bytes that stores the message
+ * length (see Message_Buffer_Set_Header_Mode).
  *
  * @param msg_buffer [IN]: Message buffer to be analyzed.
  *
@@ -63,7 +137,8 @@ uint16_t Message_Buffer_Used_Space(volatile message_buffer_t * msg_buffer);
 /**
  * @brief Get the available space (bytes) in the buffer (i.e., how many bytes can still be written).
  *
- * Obs: for each message, there is two additional bytes that stores the message length.
+ * Obs: for each message, there is up to two additional bytes that stores the message
+ * length (see Message_Buffer_Set_Header_Mode).
  *
  * @param msg_buffer [IN]: Message buffer to be analyzed.
  *
@@ -81,7 +156,8 @@ uint16_t Message_Buffer_Available_Space(volatile message_buffer_t * msg_buffer);
 uint16_t Message_Buffer_Quant_Msg(volatile message_buffer_t *msg_buffer);
 
 /**
- * @brief Clear the buffer.
+ * @brief Clear the buffer. A reserved message is not affected (it can still be
+ * committed or aborted).
  *
  * @param msg_buffer [IN]: buffer to be cleared.
  */
@@ -95,10 +171,72 @@ void Message_Buffer_Flush(volatile message_buffer_t * msg_buffer);
  * @param length [IN]: length (quantity in bytes) of the message.
  *
  * @retval buffer_status_e: Operation status, returns if the buffer is
- * full or if the data could be saved.
+ * full or if the data could be saved. BUFFER_ERROR if the length is not allowed
+ * by the header mode or if there is a pending reservation.
  */
 buffer_status_e Message_Buffer_Write_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t length);
 
+/**
+ * @brief Writes a new message to the buffer. Reentrant: can be called from several
+ * ISRs (of any priority) writing to the same buffer.
+ *
+ * The space is claimed with LDREX/STREX, so an ISR that preempts another one in
+ * the middle of a write claims the space after it. Messages are published in the
+ * order their space was claimed; a message written by a preempting ISR becomes
+ * visible when the preempted write is finished.
+ *
+ * Do not mix with Message_Buffer_Write_Message or Message_Buffer_Reserve on the same buffer.
+ *
+ * @param msg_buffer [IN]: Message buffer to receive the message
+ * @param message [IN]: message (data array) to be stored on the buffer
+ * @param length [IN]: length (quantity in bytes) of the message.
+ *
+ * @retval buffer_status_e: BUFFER_OK if written, BUFFER_FULL if there is no space
+ * or MESSAGE_MP_SLOTS messages are being written, BUFFER_ERROR if the length is not
+ * allowed by the header mode.
+ */
+buffer_status_e Message_Buffer_Write_Message_MP(volatile message_buffer_t *msg_buffer, const uint8_t *message, uint16_t length);
+
+/**
+ * @brief Reserves space for a new message, to be filled in place (zero-copy) and
+ * then published with Message_Buffer_Commit or dropped with Message_Buffer_Abort.
+ *
+ * The payload may wrap around the end of the buffer storage, so the space is
+ * returned as two parts: part1 followed by part2 (length2 is 0 if it does not wrap).
+ * Only one message can be reserved at a time, and Message_Buffer_Write_Message
+ * fails until it is committed or aborted.
+ *
+ * @param msg_buffer [IN]: Message buffer to receive the message.
+ * @param length [IN]: length (quantity in bytes) of the message.
+ * @param part1 [OUT]: first part of the payload.
+ * @param length1 [OUT]: length of the first part.
+ * @param part2 [OUT]: second part of the payload.
+ * @param length2 [OUT]: length of the second part.
+ *
+ * @retval buffer_status_e: BUFFER_OK if reserved, BUFFER_FULL if there is no
+ * space, BUFFER_ERROR if the length is not allowed by the header mode or if
+ * another message is already reserved.
+ */
+buffer_status_e Message_Buffer_Reserve(volatile message_buffer_t *msg_buffer, uint16_t length, uint8_t **part1, uint16_t *length1, uint8_t **part2, uint16_t *length2);
+
+/**
+ * @brief Publishes the message reserved with Message_Buffer_Reserve. The header
+ * and the payload become visible to the reader at once.
+ *
+ * @param msg_buffer [IN]: Message buffer with the reserved message.
+ *
+ * @retval buffer_status_e: BUFFER_OK if published, BUFFER_ERROR if there is no
+ * reservation, BUFFER_FULL if the reserved space was lost (the reservation is dropped).
+ */
+buffer_status_e Message_Buffer_Commit(volatile message_buffer_t *msg_buffer);
+
+/**
+ * @brief Drops the message reserved with Message_Buffer_Reserve. Nothing is written.
+ *
+ * @param msg_buffer [IN]: Message buffer with the reserved message.
+ */
+void Message_Buffer_Abort(volatile message_buffer_t *msg_buffer);
+
 /**
  * @brief Reads a message from the buffer. The message is removed from the buffer.
  *
@@ -111,6 +249,37 @@ buffer_status_e Message_Buffer_Write_Message(volatile message_buffer_t *msg_buff
  */
 buffer_status_e Message_Buffer_Read_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t *length);
 
+/**
+ * @brief Removes the oldest message from the buffer without copying it.
+ *
+ * Used after the message was consumed in place, e.g. sent by DMA from the
+ * spans given by Message_Buffer_Peek_Message_Spans.
+ *
+ * @param msg_buffer [IN]: Message buffer to be read from.
+ *
+ * @retval buffer_status_e: Operation status, returns if the buffer is
+ * empty or if the message was removed.
+ */
+buffer_status_e Message_Buffer_Drop_Message(volatile message_buffer_t *msg_buffer);
+
+/**
+ * @brief Reads up to max_msgs messages (or up to max_bytes of payload) at once. The messages are removed from the buffer.
+ *
+ * The payloads are stored back to back in messages (without headers) and the
+ * length of each one in lengths, e.g. to be sent by a single DMA transfer.
+ * Messages are read in order; it stops at the first one that does not fit in
+ * the remaining max_bytes.
+ *
+ * @param msg_buffer [IN]: Message buffer to be read from.
+ * @param messages [OUT]: payloads of the messages read.
+ * @param max_bytes [IN]: size (bytes) of the messages array.
+ * @param lengths [OUT]: length of each message read.
+ * @param max_msgs [IN]: size of the lengths array.
+ *
+ * @retval uint16_t quantity of messages read.
+ */
+uint16_t Message_Buffer_Read_Batch(volatile message_buffer_t *msg_buffer, uint8_t *messages, uint16_t max_bytes, uint16_t *lengths, uint16_t max_msgs);
+
 /**
  * @brief Peeks a message from the buffer. The message is not removed from the buffer (non-destructive).
  *
@@ -124,7 +293,27 @@ buffer_status_e Message_Buffer_Read_Message(volatile message_buffer_t *msg_buffe
 buffer_status_e Message_Buffer_Peek_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t *length);
 
 /**
- * @brief Peeks a message from the buffer. The message is not removed from the buffer (non-destructive).
+ * @brief Peeks the oldest message in place, without copying it (zero-copy). The message is not removed from the buffer.
+ *
+ * The payload may wrap around the end of the buffer storage, so it is returned
+ * as two parts: part1 followed by part2 (length2 is 0 if the payload does not wrap).
+ * The pointers are valid until the message is read or the buffer is flushed.
+ *
+ * @param msg_buffer [IN]: Message buffer to be peeked from.
+ * @param part1 [OUT]: first part of the payload.
+ * @param length1 [OUT]: length of the first part.
+ * @param part2 [OUT]: second part of the payload.
+ * @param length2 [OUT]: length of the second part.
+ *
+ * @retval buffer_status_e: Operation status, returns if the buffer is
+ * empty or if the message could be peeked.
+ */
+buffer_status_e Message_Buffer_Peek_Message_Spans(volatile message_buffer_t *msg_buffer, const uint8_t **part1, uint16_t *length1, const uint8_t **part2, uint16_t *length2);
+
+/**
+ * @brief Peeks the latest message written to the buffer. The message is not removed from the buffer (non-destructive).
+ *
+ * Runs in O(1).
  *
  * @param msg_buffer [IN]: Message buffer to be peeked from.
  * @param *message [OUT]: message (data array) peeked.
@@ -135,6 +324,22 @@ buffer_status_e Message_Buffer_Peek_Message(volatile message_buffer_t *msg_buffe
  */
 buffer_status_e Message_Buffer_Peek_Last_Message(volatile message_buffer_t *msg_buffer, uint8_t *message, uint16_t *length);
 
+/**
+ * @brief Peeks the Nth message of the buffer (0 is the oldest). The message is not removed from the buffer (non-destructive).
+ *
+ * Runs in O(1) for the newest MESSAGE_INDEX_STACK_SIZE messages. Older messages
+ * are found by walking the headers from the oldest one.
+ *
+ * @param msg_buffer [IN]: Message buffer to be peeked from.
+ * @param n [IN]: position of the message, from 0 (oldest) to quantity of messages - 1 (latest).
+ * @param *message [OUT]: message (data array) peeked.
+ * @param length [OUT]: length of the message.
+ *
+ * @retval buffer_status_e: Operation status, returns BUFFER_EMPTY if there is
+ * no Nth message.
+ */
+buffer_status_e Message_Buffer_Peek_Nth_Message(volatile message_buffer_t *msg_buffer, uint16_t n, uint8_t *message, uint16_t *length);
+
 
 #ifdef __cplusplus
 }
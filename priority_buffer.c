@@ -0,0 +1,165 @@
+#include "priority_buffer.h"
+
+#include <stddef.h>
+
+/*
+ * pending has bit (31 - level) set while the level may have messages, so the
+ * highest priority level with messages is the count of leading zeros.
+ * The writer sets the bit after the message is written. The reader clears it
+ * when it finds the level empty, then checks the level again, since the writer
+ * may have written a message in between.
+ */
+
+CIRCULAR_BUFFER_STATIC_ASSERT((PRIORITY_BUFFER_LEVELS >= 1) && (PRIORITY_BUFFER_LEVELS <= 32),
+    "PRIORITY_BUFFER_LEVELS must be 1 to 32");
+
+#if defined(__arm__)
+#define PRIORITY_BUFFER_CLZ(value)  __CLZ(value)
+#else
+#define PRIORITY_BUFFER_CLZ(value)  ((uint8_t)__builtin_clz(value))
+#endif
+
+#define PRIORITY_BUFFER_BIT(level)  (0x80000000UL >> (level))
+
+static void Priority_Buffer_Set_Pending(volatile priority_buffer_t * p_buffer, uint8_t level)
+{
+    uint32_t pending;
+
+    do
+    {
+        pending = p_buffer->pending;
+    } while (!Circular_Buffer_Swap32(&p_buffer->pending, pending, pending | PRIORITY_BUFFER_BIT(level)));
+}
+
+static void Priority_Buffer_Clear_Pending(volatile priority_buffer_t * p_buffer, uint8_t level)
+{
+    uint32_t pending;
+
+    do
+    {
+        pending = p_buffer->pending;
+    } while (!Circular_Buffer_Swap32(&p_buffer->pending, pending, pending & ~PRIORITY_BUFFER_BIT(level)));
+
+    // A message may have been written before the bit was cleared
+    if (!Message_Buffer_Is_Empty(&p_buffer->levels[level]))
+        Priority_Buffer_Set_Pending(p_buffer, level);
+}
+
+static int8_t Priority_Buffer_Next_Level(volatile priority_buffer_t * p_buffer)
+{
+    uint32_t pending;
+    uint8_t level;
+
+    while ((pending = p_buffer->pending) != 0)
+    {
+        level = PRIORITY_BUFFER_CLZ(pending);
+
+        if (!Message_Buffer_Is_Empty(&p_buffer->levels[level]))
+            return level;
+
+        Priority_Buffer_Clear_Pending(p_buffer, level);
+    }
+
+    return -1;
+}
+
+buffer_status_e Priority_Buffer_Init(volatile priority_buffer_t * p_buffer, uint8_t * storage, const uint16_t * budgets)
+{
+    buffer_status_e status = BUFFER_OK;
+
+    // A level with an invalid budget refuses every message, and its bytes stay unused
+    for (uint8_t i = 0; i < PRIORITY_BUFFER_LEVELS; i++)
+    {
+        if (BUFFER_OK != Message_Buffer_Init(&p_buffer->levels[i], storage, budgets[i]))
+            status = BUFFER_ERROR;
+
+        storage += budgets[i];
+    }
+
+    p_buffer->pending = 0;
+
+    return status;
+}
+
+uint8_t Priority_Buffer_Is_Empty(volatile priority_buffer_t * p_buffer)
+{
+    return (Priority_Buffer_Next_Level(p_buffer) < 0);
+}
+
+uint16_t Priority_Buffer_Quant_Msg(volatile priority_buffer_t * p_buffer)
+{
+    uint16_t quant_msg = 0;
+
+    for (uint8_t i = 0; i < PRIORITY_BUFFER_LEVELS; i++)
+        quant_msg += Message_Buffer_Quant_Msg(&p_buffer->levels[i]);
+
+    return quant_msg;
+}
+
+uint16_t Priority_Buffer_Available_Space(volatile priority_buffer_t * p_buffer, uint8_t level)
+{
+    if (level >= PRIORITY_BUFFER_LEVELS)
+        return 0;
+
+    return Message_Buffer_Available_Space(&p_buffer->levels[level]);
+}
+
+void Priority_Buffer_Flush(volatile priority_buffer_t * p_buffer)
+{
+    for (uint8_t i = 0; i < PRIORITY_BUFFER_LEVELS; i++)
+    {
+        Message_Buffer_Flush(&p_buffer->levels[i]);
+        Priority_Buffer_Clear_Pending(p_buffer, i);
+    }
+}
+
+buffer_status_e Priority_Buffer_Write_Message(volatile priority_buffer_t * p_buffer, uint8_t level, uint8_t * message, uint16_t length)
+{
+    buffer_status_e status;
+
+    if (level >= PRIORITY_BUFFER_LEVELS)
+        return BUFFER_ERROR;
+
+    status = Message_Buffer_Write_Message(&p_buffer->levels[level], message, length);
+
+    if (status == BUFFER_OK)
+        Priority_Buffer_Set_Pending(p_buffer, level);
+
+    return status;
+}
+
+buffer_status_e Priority_Buffer_Read_Message(volatile priority_buffer_t * p_buffer, uint8_t * message, uint16_t * length, uint8_t * level)
+{
+    int8_t next = Priority_Buffer_Next_Level(p_buffer);
+    buffer_status_e status;
+
+    if (next < 0)
+        return BUFFER_EMPTY;
+
+    status = Message_Buffer_Read_Message(&p_buffer->levels[next], message, length);
+
+    if (status != BUFFER_OK)
+        return status;
+
+    if (level != NULL)
+        *level = (uint8_t)next;
+
+    // Last message of the level: the next read goes to a lower level
+    if (Message_Buffer_Is_Empty(&p_buffer->levels[next]))
+        Priority_Buffer_Clear_Pending(p_buffer, next);
+
+    return BUFFER_OK;
+}
+
+buffer_status_e Priority_Buffer_Peek_Message(volatile priority_buffer_t * p_buffer, uint8_t * message, uint16_t * length, uint8_t * level)
+{
+    int8_t next = Priority_Buffer_Next_Level(p_buffer);
+
+    if (next < 0)
+        return BUFFER_EMPTY;
+
+    if (level != NULL)
+        *level = (uint8_t)next;
+
+    return Message_Buffer_Peek_Message(&p_buffer->levels[next], message, length);
+}
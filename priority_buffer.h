@@ -0,0 +1,148 @@
+/**
+ * @file priority_buffer.h
+ *
+ * @brief Module to store/read messages with priority levels.
+ *
+ * Each level is a message_buffer_t with its own part of the storage (its byte
+ * budget), so a level that is full (e.g. bulk logging) never takes the space of
+ * another one (e.g. control frames). Messages are read from the highest priority
+ * level that has messages (level 0 is the highest), in FIFO order inside a level.
+ *
+ * A bitmap of the non-empty levels gives the next level with a single CLZ, so
+ * reading does not depend on the quantity of levels.
+ *
+ * Same rules as message_buffer: one writer per level and one reader.
+ *
+ *      static const uint16_t budgets[PRIORITY_BUFFER_LEVELS] = {256, 256, 1024, 512};
+ *      static uint8_t tx_storage[256 + 256 + 1024 + 512];
+ *      static volatile priority_buffer_t tx_buffer;
+ *
+ *      Priority_Buffer_Init(&tx_buffer, tx_storage, budgets);
+ *      Priority_Buffer_Write_Message(&tx_buffer, 0, alarm, alarm_length);
+ */
+
+#ifndef UTILS_PRIORITY_BUFFER_H_
+#define UTILS_PRIORITY_BUFFER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "message_buffer.h"
+
+/**
+ * @brief Quantity of priority levels (1 to 32).
+ *
+ */
+#ifndef PRIORITY_BUFFER_LEVELS
+#define PRIORITY_BUFFER_LEVELS 4
+#endif
+
+/**
+ * @brief Struct definition of the Priority Buffer.
+ *
+ */
+typedef struct
+{
+    message_buffer_t levels[PRIORITY_BUFFER_LEVELS];    /**< Message buffer of each level (0 is the highest priority) */
+    uint32_t pending;                                   /**< Bit (31 - level) is set if the level may have messages */
+} priority_buffer_t;
+
+
+/**
+ * @brief Init variables of the priority buffer.
+ *
+ * The storage is split among the levels: level 0 uses the first budgets[0] bytes,
+ * level 1 the next budgets[1] bytes, and so on.
+ *
+ * @param p_buffer [IN]: Priority buffer to be initialized.
+ * @param storage [IN]: Storage array, with the sum of the budgets as size.
+ * @param budgets [IN]: Size (bytes) of each level. Each one must be a 2^N value.
+ *
+ * @retval buffer_status_e: BUFFER_OK, or BUFFER_ERROR if a budget is not a 2^N
+ * value (that level then refuses every message).
+ */
+buffer_status_e Priority_Buffer_Init(volatile priority_buffer_t * p_buffer, uint8_t * storage, const uint16_t * budgets);
+
+/**
+ * @brief Verify if all the levels are empty.
+ *
+ * @param p_buffer [IN]: Priority buffer to be analyzed.
+ *
+ * @retval 1 if empty, 0 if not empty.
+ */
+uint8_t Priority_Buffer_Is_Empty(volatile priority_buffer_t * p_buffer);
+
+/**
+ * @brief Get the quantity of messages in all the levels.
+ *
+ * @param p_buffer [IN]: Priority buffer to be analyzed.
+ *
+ * @retval uint16_t quantity of messages.
+ */
+uint16_t Priority_Buffer_Quant_Msg(volatile priority_buffer_t * p_buffer);
+
+/**
+ * @brief Get the available space (bytes) of a level.
+ *
+ * @param p_buffer [IN]: Priority buffer to be analyzed.
+ * @param level [IN]: Priority level.
+ *
+ * @retval uint16_t number of bytes available to write in the level (0 if the level does not exist).
+ */
+uint16_t Priority_Buffer_Available_Space(volatile priority_buffer_t * p_buffer, uint8_t level);
+
+/**
+ * @brief Clear all the levels.
+ *
+ * @param p_buffer [IN]: buffer to be cleared.
+ */
+void Priority_Buffer_Flush(volatile priority_buffer_t * p_buffer);
+
+/**
+ * @brief Writes a new message to a level.
+ *
+ * @param p_buffer [IN]: Priority buffer to receive the message.
+ * @param level [IN]: Priority level (0 is the highest).
+ * @param message [IN]: message (data array) to be stored on the buffer.
+ * @param length [IN]: length (quantity in bytes) of the message.
+ *
+ * @retval buffer_status_e: BUFFER_OK if written, BUFFER_FULL if the budget of
+ * the level is used up, BUFFER_ERROR if the level does not exist (or see
+ * Message_Buffer_Write_Message).
+ */
+buffer_status_e Priority_Buffer_Write_Message(volatile priority_buffer_t * p_buffer, uint8_t level, uint8_t * message, uint16_t length);
+
+/**
+ * @brief Reads the oldest message of the highest priority level. The message is removed from the buffer.
+ *
+ * @param p_buffer [IN]: Priority buffer to be read from.
+ * @param message [OUT]: message (data array) read.
+ * @param length [OUT]: length of the message.
+ * @param level [OUT]: level of the message. Can be NULL.
+ *
+ * @retval buffer_status_e: Operation status, returns if the buffer is
+ * empty or if the data could be read.
+ */
+buffer_status_e Priority_Buffer_Read_Message(volatile priority_buffer_t * p_buffer, uint8_t * message, uint16_t * length, uint8_t * level);
+
+/**
+ * @brief Peeks the message that Priority_Buffer_Read_Message would read. The message is not removed from the buffer.
+ *
+ * @param p_buffer [IN]: Priority buffer to be peeked from.
+ * @param message [OUT]: message (data array) peeked.
+ * @param length [OUT]: length of the message.
+ * @param level [OUT]: level of the message. Can be NULL.
+ *
+ * @retval buffer_status_e: Operation status, returns if the buffer is
+ * empty or if the data could be peeked.
+ */
+buffer_status_e Priority_Buffer_Peek_Message(volatile priority_buffer_t * p_buffer, uint8_t * message, uint16_t * length, uint8_t * level);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTILS_PRIORITY_BUFFER_H_ */
@@ -0,0 +1,99 @@
+/**
+ * @file bench_circular_array.c
+ *
+ * @brief Cost of the circular buffer array functions against the per-byte
+ *  loop they replaced (one Write_Byte/Read_Byte call per byte), for transfers
+ *  of 1 to 1023 bytes through a 1024 bytes buffer.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "circular_buffer.h"
+#include "test.h"
+
+CIRCULAR_BUFFER_STORAGE(storage, 1024);
+static volatile circular_buffer_t buffer;
+static uint8_t source[1024];
+static uint8_t dest[1024];
+
+static double Now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec * 1e9) + t.tv_nsec;
+}
+
+/* Array functions before the block copies */
+static buffer_status_e Byte_Loop_Write_Array(volatile circular_buffer_t * buffer, const uint8_t * data, uint16_t length)
+{
+    if (Circular_Buffer_Available_Space(buffer) < length)
+    {
+        return BUFFER_FULL;
+    }
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        Circular_Buffer_Write_Byte(buffer, data[i]);
+    }
+
+    return BUFFER_OK;
+}
+
+static uint16_t Byte_Loop_Read_Array(volatile circular_buffer_t * buffer, uint8_t * data, uint16_t max_length)
+{
+    uint16_t i = 0;
+
+    while ((i < max_length) && (BUFFER_OK == Circular_Buffer_Read_Byte(buffer, &data[i])))
+    {
+        i++;
+    }
+
+    return i;
+}
+
+int main(void)
+{
+    const uint16_t lengths[] = {1, 8, 64, 256, 1023};
+
+    for (uint16_t i = 0; i < sizeof(source); i++)
+    {
+        source[i] = (uint8_t)i;
+    }
+
+    Circular_Buffer_Init(&buffer, storage, sizeof(storage));
+
+    printf("length   byte loop ns/B   block copy ns/B   speedup\n");
+
+    for (uint16_t k = 0; k < sizeof(lengths) / sizeof(lengths[0]); k++)
+    {
+        uint16_t length = lengths[k];
+        uint32_t rounds = 20000000UL / length + 1000;
+        double start;
+        double byte_loop;
+        double block;
+
+        start = Now_ns();
+        for (uint32_t r = 0; r < rounds; r++)
+        {
+            Byte_Loop_Write_Array(&buffer, source, length);
+            TEST_ASSERT(length == Byte_Loop_Read_Array(&buffer, dest, length));
+        }
+        byte_loop = (Now_ns() - start) / rounds / length;
+
+        start = Now_ns();
+        for (uint32_t r = 0; r < rounds; r++)
+        {
+            Circular_Buffer_Write_Array(&buffer, source, length);
+            TEST_ASSERT(length == Circular_Buffer_Read_Array(&buffer, dest, length));
+        }
+        block = (Now_ns() - start) / rounds / length;
+
+        TEST_ASSERT(0 == memcmp(source, dest, length));
+        printf("%6u   %14.2f   %15.2f   %6.1fx\n", length, byte_loop, block, byte_loop / block);
+    }
+
+    return 0;
+}
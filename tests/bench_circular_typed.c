@@ -0,0 +1,67 @@
+/**
+ * @file bench_circular_typed.c
+ *
+ * @brief Cost of a 16 bits sample through circular_buffer_u16_t against the
+ *  same sample split into two bytes through the byte buffer array functions.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include "circular_buffer_typed.h"
+#include "test.h"
+
+#define SAMPLES     20000000UL
+
+CIRCULAR_BUFFER_STORAGE(byte_storage, 512);
+CIRCULAR_BUFFER_TYPED_STORAGE(u16_storage, uint16_t, 256);
+static volatile circular_buffer_t byte_buffer;
+static volatile circular_buffer_u16_t u16_buffer;
+
+static double Now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec * 1e9) + t.tv_nsec;
+}
+
+int main(void)
+{
+    uint32_t sum_split = 0;
+    uint32_t sum_u16 = 0;
+    double start;
+    double split;
+    double typed;
+
+    Circular_Buffer_Init(&byte_buffer, byte_storage, sizeof(byte_storage));
+    Circular_Buffer_U16_Init(&u16_buffer, u16_storage, 256);
+
+    start = Now_ns();
+    for (uint32_t i = 0; i < SAMPLES; i++)
+    {
+        uint16_t sample = (uint16_t)i;
+        uint8_t bytes[2] = {(uint8_t)(sample >> 8), (uint8_t)sample};
+
+        Circular_Buffer_Write_Array(&byte_buffer, bytes, 2);
+        TEST_ASSERT(2 == Circular_Buffer_Read_Array(&byte_buffer, bytes, 2));
+        sum_split += ((uint16_t)bytes[0] << 8) | bytes[1];
+    }
+    split = (Now_ns() - start) / SAMPLES;
+
+    start = Now_ns();
+    for (uint32_t i = 0; i < SAMPLES; i++)
+    {
+        uint16_t sample = (uint16_t)i;
+
+        Circular_Buffer_U16_Write(&u16_buffer, sample);
+        TEST_ASSERT(BUFFER_OK == Circular_Buffer_U16_Read(&u16_buffer, &sample));
+        sum_u16 += sample;
+    }
+    typed = (Now_ns() - start) / SAMPLES;
+
+    TEST_ASSERT(sum_split == sum_u16);
+    printf("byte split: %.2f ns/sample, u16 buffer: %.2f ns/sample\n", split, typed);
+
+    return 0;
+}
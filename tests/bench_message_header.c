@@ -0,0 +1,134 @@
+/**
+ * @file bench_message_header.c
+ *
+ * @brief Messages that fit in a 1 KB message buffer with each header mode,
+ *  for several message length distributions.
+ *
+ * The buffer is filled until a write is refused, FILLS times with different
+ * pseudo-random lengths, and the mean count is printed. In MESSAGE_HEADER_NONE
+ * mode every message takes the largest length of the distribution.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "message_buffer.h"
+#include "test.h"
+
+#define BUFFER_SIZE     1024
+#define FILLS           100
+
+typedef struct
+{
+    const char *name;
+    uint16_t min;           // lengths of the short messages
+    uint16_t max;
+    uint16_t long_min;      // lengths of the long ones, 1 in long_every (0: none)
+    uint16_t long_max;
+    uint16_t long_every;
+} length_distribution_t;
+
+static const length_distribution_t distributions[] =
+{
+    {"fixed 4",             4,  4,   0,   0,  0},
+    {"fixed 8",             8,  8,   0,   0,  0},
+    {"uniform 4-20",        4, 20,   0,   0,  0},
+    {"mixed 4-8/100-200",   4,  8, 100, 200, 10},
+};
+
+static const struct
+{
+    const char *name;
+    message_header_mode_e mode;
+} modes[] =
+{
+    {"fixed",   MESSAGE_HEADER_FIXED},
+    {"compact", MESSAGE_HEADER_COMPACT},
+    {"none",    MESSAGE_HEADER_NONE},
+};
+
+CIRCULAR_BUFFER_STORAGE(storage, BUFFER_SIZE);
+static volatile message_buffer_t msg_buffer;
+static uint8_t message[256];
+static uint32_t random_state;
+
+static uint32_t Random(void)
+{
+    random_state = random_state * 1103515245UL + 12345UL;
+    return random_state >> 16;
+}
+
+static uint16_t Random_Range(uint16_t min, uint16_t max)
+{
+    return min + (uint16_t)(Random() % (max - min + 1U));
+}
+
+static uint16_t Length(const length_distribution_t *dist)
+{
+    if (dist->long_every && (0 == (Random() % dist->long_every)))
+    {
+        return Random_Range(dist->long_min, dist->long_max);
+    }
+
+    return Random_Range(dist->min, dist->max);
+}
+
+/**
+ * @brief Writes messages until the buffer is full, returns how many fit.
+ */
+static uint32_t Fill(const length_distribution_t *dist, message_header_mode_e mode, uint32_t seed)
+{
+    uint16_t record_size = (dist->long_every) ? dist->long_max : dist->max;
+    uint32_t count = 0;
+
+    random_state = seed;
+    Message_Buffer_Init(&msg_buffer, storage, BUFFER_SIZE);
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Set_Header_Mode(&msg_buffer, mode, record_size));
+
+    while (1)
+    {
+        uint16_t length = (MESSAGE_HEADER_NONE == mode) ? record_size : Length(dist);
+
+        if (BUFFER_OK != Message_Buffer_Write_Message(&msg_buffer, message, length))
+        {
+            break;
+        }
+
+        count++;
+    }
+
+    TEST_ASSERT(count == Message_Buffer_Quant_Msg(&msg_buffer));
+
+    return count;
+}
+
+int main(void)
+{
+    printf("%-20s", "messages per KB");
+    for (uint32_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        printf("%10s", modes[m].name);
+    }
+    printf("\n");
+
+    for (uint32_t d = 0; d < sizeof(distributions) / sizeof(distributions[0]); d++)
+    {
+        printf("%-20s", distributions[d].name);
+
+        for (uint32_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+        {
+            uint32_t total = 0;
+
+            for (uint32_t seed = 1; seed <= FILLS; seed++)
+            {
+                total += Fill(&distributions[d], modes[m].mode, seed);
+            }
+
+            printf("%10.1f", (double)total / FILLS);
+        }
+
+        printf("\n");
+    }
+
+    return 0;
+}
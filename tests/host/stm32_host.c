@@ -0,0 +1,56 @@
+/**
+ * @file stm32_host.c
+ *
+ * @brief Host memory at the peripheral and core register addresses, see
+ *  stm32_host.h.
+ */
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "stm32_host.h"
+#include "../test.h"
+
+#define HOST_PERIPH_SIZE    0x30000     // APB1, APB2 and AHB (DMA1, RCC, FLASH)
+#define HOST_CORE_BASE      0xE0000000UL
+#define HOST_CORE_SIZE      0x10000     // DWT, SysTick, NVIC, SCB, CoreDebug
+
+volatile uint32_t host_primask = 0;
+volatile uint32_t host_ipsr = 0;
+
+__attribute__((weak)) void Host_WFI(void)
+{
+}
+
+static void Host_Map(uintptr_t base, size_t size)
+{
+    void * memory = mmap((void *)base, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    TEST_ASSERT((void *)base == memory);
+}
+
+void Host_Reset(void)
+{
+    memset((void *)PERIPH_BASE, 0, HOST_PERIPH_SIZE);
+    memset((void *)HOST_CORE_BASE, 0, HOST_CORE_SIZE);
+
+    // Clock ready flags, as if the hardware was done
+    RCC->CR = RCC_CR_HSION | RCC_CR_HSIRDY | RCC_CR_PLLRDY;
+    RCC->CFGR = RCC_CFGR_SWS_PLL;
+
+    // USART transmitters idle
+    USART1->SR = USART_SR_TXE | USART_SR_TC;
+    USART2->SR = USART_SR_TXE | USART_SR_TC;
+    USART3->SR = USART_SR_TXE | USART_SR_TC;
+
+    host_primask = 0;
+    host_ipsr = 0;
+}
+
+__attribute__((constructor)) static void Host_Init(void)
+{
+    Host_Map(PERIPH_BASE, HOST_PERIPH_SIZE);
+    Host_Map(HOST_CORE_BASE, HOST_CORE_SIZE);
+    Host_Reset();
+}
@@ -0,0 +1,47 @@
+/**
+ * @file stm32_host.h
+ *
+ * @brief Host build of the drivers that access the peripherals.
+ *
+ * Force-included before each source (-include host/stm32_host.h). The
+ * peripheral and core registers keep their CMSIS addresses: stm32_host.c maps
+ * host memory there before main, so the drivers run unchanged and the tests
+ * read and write the registers as the hardware would. Programs must be linked
+ * with -no-pie, so that the static buffers given to the DMA fit in 32 bits.
+ *
+ * The core intrinsics that cannot run on the host are replaced:
+ *  - PRIMASK is a variable (interrupts are never taken on their own, the test
+ *    calls the handlers),
+ *  - IPSR is a variable, set by the test to run code "in handler mode",
+ *  - WFI calls Host_WFI, where the test advances the simulated time.
+ */
+
+#ifndef TESTS_HOST_STM32_HOST_H_
+#define TESTS_HOST_STM32_HOST_H_
+
+#include "stm32f1xx.h"
+
+extern volatile uint32_t host_primask;
+extern volatile uint32_t host_ipsr;
+
+/**
+ * @brief Called by __WFI. The default one does nothing; a test defines its own
+ *  to make the interrupt that wakes up the CPU happen.
+ */
+void Host_WFI(void);
+
+/**
+ * @brief Clears all the registers, then sets the ones the drivers wait on
+ *  (clock ready flags, USART TXE/TC). Called before main.
+ */
+void Host_Reset(void);
+
+#define __get_PRIMASK()     (host_primask)
+#define __set_PRIMASK(x)    (host_primask = (x))
+#define __disable_irq()     (host_primask = 1)
+#define __enable_irq()      (host_primask = 0)
+#define __get_IPSR()        (host_ipsr)
+#undef __WFI
+#define __WFI()             Host_WFI()
+
+#endif /* TESTS_HOST_STM32_HOST_H_ */
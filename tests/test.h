@@ -0,0 +1,27 @@
+/**
+ * @file test.h
+ *
+ * @brief Assertions of the host tests. A failed check prints where it failed
+ *  and exits with an error, so make stops at the first failing test.
+ */
+
+#ifndef TESTS_TEST_H_
+#define TESTS_TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_ASSERT(cond) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define TEST_PASS(name) \
+    printf("%s: ok\n", (name))
+
+#endif /* TESTS_TEST_H_ */
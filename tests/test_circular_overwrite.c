@@ -0,0 +1,154 @@
+/**
+ * @file test_circular_overwrite.c
+ *
+ * @brief Tests of the overwrite-oldest write of circular_buffer_t.
+ *
+ *  - A consumer copy is only kept if i_first did not move meanwhile, so
+ *    dropping any quantity of bytes (below 65536), including whole multiples of
+ *    the buffer size, must change i_first.
+ *  - Single thread: the buffer keeps the newest bytes and counts the dropped ones.
+ *  - Two threads: a producer overwriting a counter sequence while the main
+ *    thread reads. Every read must return consecutive values (no torn copy),
+ *    and read + dropped must add up to the bytes written.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "circular_buffer.h"
+#include "test.h"
+
+#define OVERWRITE_SIZE  16
+
+static uint8_t storage[OVERWRITE_SIZE];
+static volatile circular_buffer_t buffer;
+static uint64_t total;
+static volatile uint8_t producer_done;
+
+static void Test_Index_Changes_On_Drop(void)
+{
+    Circular_Buffer_Init(&buffer, storage, OVERWRITE_SIZE);
+
+    for (uint16_t i = 0; i < OVERWRITE_SIZE - 1; i++)
+    {
+        TEST_ASSERT(BUFFER_OK == Circular_Buffer_Write_Byte_Overwrite(&buffer, (uint8_t)i));
+    }
+
+    // Several wraps of i_first, through the 16 bits wrap of the index
+    for (uint32_t round = 0; round < 70000; round += OVERWRITE_SIZE * 4)
+    {
+        uint16_t first = buffer.i_first;
+
+        for (uint16_t dropped = 1; dropped <= OVERWRITE_SIZE * 4; dropped++)
+        {
+            TEST_ASSERT(BUFFER_FULL == Circular_Buffer_Write_Byte_Overwrite(&buffer, (uint8_t)dropped));
+            TEST_ASSERT(buffer.i_first != first);
+        }
+    }
+}
+
+static void Test_Keeps_Newest(void)
+{
+    uint8_t data[OVERWRITE_SIZE];
+    uint8_t byte;
+
+    Circular_Buffer_Init(&buffer, storage, OVERWRITE_SIZE);
+
+    for (uint16_t i = 0; i < 100; i++)
+    {
+        Circular_Buffer_Write_Byte_Overwrite(&buffer, (uint8_t)i);
+    }
+
+    TEST_ASSERT(Circular_Buffer_Is_Full(&buffer));
+    TEST_ASSERT((100 - (OVERWRITE_SIZE - 1)) == Circular_Buffer_Get_Overflow_Count(&buffer));
+    TEST_ASSERT(BUFFER_OK == Circular_Buffer_Peek_Last(&buffer, &byte));
+    TEST_ASSERT(99 == byte);
+    TEST_ASSERT((OVERWRITE_SIZE - 1) == Circular_Buffer_Read_Array(&buffer, data, sizeof(data)));
+
+    for (uint16_t i = 0; i < OVERWRITE_SIZE - 1; i++)
+    {
+        TEST_ASSERT(data[i] == (uint8_t)(100 - (OVERWRITE_SIZE - 1) + i));
+    }
+
+    TEST_ASSERT(Circular_Buffer_Is_Empty(&buffer));
+    TEST_ASSERT(BUFFER_OK == Circular_Buffer_Write_Byte_Overwrite(&buffer, 1));
+}
+
+static void * Producer(void * arg)
+{
+    (void)arg;
+
+    for (uint64_t i = 0; i < total; i++)
+    {
+        Circular_Buffer_Write_Byte_Overwrite(&buffer, (uint8_t)i);
+
+        if (0 == (i & 0xFF))
+        {
+            sched_yield();
+        }
+    }
+
+    producer_done = 1;
+    return NULL;
+}
+
+static void Test_Concurrent_Reader(void)
+{
+    pthread_t producer;
+    uint64_t received = 0;
+    uint32_t seed = 3;
+
+    Circular_Buffer_Init(&buffer, storage, OVERWRITE_SIZE);
+    producer_done = 0;
+    TEST_ASSERT(0 == pthread_create(&producer, NULL, Producer, NULL));
+
+    while (!producer_done || !Circular_Buffer_Is_Empty(&buffer))
+    {
+        uint8_t data[OVERWRITE_SIZE];
+        uint16_t length;
+
+        seed = seed * 1103515245 + 12345;
+
+        if (0 == ((seed >> 16) & 1))
+        {
+            length = Circular_Buffer_Read_Array(&buffer, data, OVERWRITE_SIZE);
+        }
+        else
+        {
+            length = Circular_Buffer_Peek_Array(&buffer, data, OVERWRITE_SIZE);
+            length = (length > 0) ? Circular_Buffer_Read_Array(&buffer, data, length) : 0;
+        }
+
+        // Bytes dropped while copying must not be mixed with newer ones
+        for (uint16_t k = 1; k < length; k++)
+        {
+            TEST_ASSERT(data[k] == (uint8_t)(data[k - 1] + 1));
+        }
+
+        received += length;
+
+        if (0 == length)
+        {
+            sched_yield();
+        }
+    }
+
+    TEST_ASSERT(0 == pthread_join(producer, NULL));
+    TEST_ASSERT(total == received + Circular_Buffer_Get_Overflow_Count(&buffer));
+    printf("%llu bytes read, %lu dropped\n", (unsigned long long)received,
+           (unsigned long)Circular_Buffer_Get_Overflow_Count(&buffer));
+}
+
+int main(int argc, char ** argv)
+{
+    total = (argc > 1) ? strtoull(argv[1], NULL, 0) : 2000000;
+
+    Test_Index_Changes_On_Drop();
+    Test_Keeps_Newest();
+    Test_Concurrent_Reader();
+
+    TEST_PASS("test_circular_overwrite");
+    return 0;
+}
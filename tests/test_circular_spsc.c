@@ -0,0 +1,192 @@
+/**
+ * @file test_circular_spsc.c
+ *
+ * @brief SPSC stress test of circular_buffer_t: a producer thread writes a
+ *  known byte sequence while the main thread reads it back, each side mixing
+ *  the byte, array and span functions. Any byte lost, duplicated or read before
+ *  it was written breaks the sequence.
+ *
+ * Usage: test_circular_spsc [bytes per buffer size]
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "circular_buffer.h"
+#include "test.h"
+
+#define SPSC_MAX_SIZE   1024
+
+static uint8_t storage[SPSC_MAX_SIZE];
+static volatile circular_buffer_t buffer;
+static uint64_t total;
+
+static inline uint8_t Sequence(uint64_t i)
+{
+    return (uint8_t)((i * 7) + (i >> 8) + 3);
+}
+
+static void * Producer(void * arg)
+{
+    uint64_t i = 0;
+    uint32_t seed = 1;
+
+    (void)arg;
+
+    while (i < total)
+    {
+        uint8_t chunk[64];
+        uint8_t * span;
+        uint16_t length;
+        uint16_t n;
+        uint64_t before = i;
+
+        seed = seed * 1103515245 + 12345;
+
+        switch ((seed >> 16) % 3)
+        {
+            case 0:
+                if (BUFFER_OK == Circular_Buffer_Write_Byte(&buffer, Sequence(i)))
+                {
+                    i++;
+                }
+            break;
+
+            case 1:
+                n = 1 + ((seed >> 20) % sizeof(chunk));
+                if (n > total - i)
+                {
+                    n = total - i;
+                }
+
+                for (uint16_t k = 0; k < n; k++)
+                {
+                    chunk[k] = Sequence(i + k);
+                }
+
+                if (BUFFER_OK == Circular_Buffer_Write_Array(&buffer, chunk, n))
+                {
+                    i += n;
+                }
+            break;
+
+            default:
+                if (BUFFER_OK == Circular_Buffer_Write_Acquire(&buffer, &span, &length))
+                {
+                    if (length > total - i)
+                    {
+                        length = total - i;
+                    }
+
+                    for (uint16_t k = 0; k < length; k++)
+                    {
+                        span[k] = Sequence(i + k);
+                    }
+
+                    TEST_ASSERT(BUFFER_OK == Circular_Buffer_Write_Commit(&buffer, length));
+                    i += length;
+                }
+            break;
+        }
+
+        // Full/empty: let the other side run (the host may have a single core)
+        if (before == i)
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void Run(uint16_t size)
+{
+    pthread_t producer;
+    uint64_t i = 0;
+    uint32_t seed = 7;
+
+    Circular_Buffer_Init(&buffer, storage, size);
+    TEST_ASSERT(0 == pthread_create(&producer, NULL, Producer, NULL));
+
+    while (i < total)
+    {
+        uint8_t chunk[64];
+        const uint8_t * span;
+        uint16_t length;
+        uint8_t byte;
+        uint64_t before = i;
+
+        seed = seed * 1103515245 + 12345;
+
+        switch ((seed >> 16) % 4)
+        {
+            case 0:
+                if (BUFFER_OK == Circular_Buffer_Read_Byte(&buffer, &byte))
+                {
+                    TEST_ASSERT(byte == Sequence(i));
+                    i++;
+                }
+            break;
+
+            case 1:
+                length = Circular_Buffer_Read_Array(&buffer, chunk, 1 + ((seed >> 20) % sizeof(chunk)));
+
+                for (uint16_t k = 0; k < length; k++)
+                {
+                    TEST_ASSERT(chunk[k] == Sequence(i + k));
+                }
+
+                i += length;
+            break;
+
+            case 2:
+                // Peeked data stays valid: only the consumer frees it
+                length = Circular_Buffer_Peek_Array(&buffer, chunk, sizeof(chunk));
+
+                for (uint16_t k = 0; k < length; k++)
+                {
+                    TEST_ASSERT(chunk[k] == Sequence(i + k));
+                }
+            break;
+
+            default:
+                if (BUFFER_OK == Circular_Buffer_Read_Peek_Span(&buffer, &span, &length))
+                {
+                    for (uint16_t k = 0; k < length; k++)
+                    {
+                        TEST_ASSERT(span[k] == Sequence(i + k));
+                    }
+
+                    TEST_ASSERT(BUFFER_OK == Circular_Buffer_Read_Consume(&buffer, length));
+                    i += length;
+                }
+            break;
+        }
+
+        // Full/empty: let the other side run (the host may have a single core)
+        if (before == i)
+        {
+            sched_yield();
+        }
+    }
+
+    TEST_ASSERT(0 == pthread_join(producer, NULL));
+    TEST_ASSERT(Circular_Buffer_Is_Empty(&buffer));
+}
+
+int main(int argc, char ** argv)
+{
+    total = (argc > 1) ? strtoull(argv[1], NULL, 0) : 1000000;
+
+    for (uint16_t size = 2; size <= SPSC_MAX_SIZE; size *= 8)
+    {
+        Run(size);
+    }
+
+    printf("%llu bytes per size\n", (unsigned long long)total);
+    TEST_PASS("test_circular_spsc");
+    return 0;
+}
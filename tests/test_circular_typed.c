@@ -0,0 +1,214 @@
+/**
+ * @file test_circular_typed.c
+ *
+ * @brief Tests of the typed buffers generated by CIRCULAR_BUFFER_TYPED_DEFINE,
+ *  with uint16_t, uint32_t and struct elements:
+ *  - full and empty detection, used and available space,
+ *  - single writes and reads in order,
+ *  - array writes and reads that wrap the end of storage (split copy),
+ *  - array writes refused when there is not enough space, with nothing written,
+ *  - sizes that are not 2^N refused by Init (also for the byte buffer).
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "circular_buffer_typed.h"
+#include "test.h"
+
+#define TYPED_COUNT     8
+
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    uint16_t time;
+} sample_t;
+
+CIRCULAR_BUFFER_TYPED_DEFINE(sample_buffer_t, Sample_Buffer, sample_t)
+
+CIRCULAR_BUFFER_TYPED_STORAGE(u16_storage, uint16_t, TYPED_COUNT);
+CIRCULAR_BUFFER_TYPED_STORAGE(u32_storage, uint32_t, TYPED_COUNT);
+CIRCULAR_BUFFER_TYPED_STORAGE(sample_storage, sample_t, TYPED_COUNT);
+static volatile circular_buffer_u16_t u16_buffer;
+static volatile circular_buffer_u32_t u32_buffer;
+static volatile sample_buffer_t sample_buffer;
+
+static sample_t Sample(uint16_t i)
+{
+    sample_t sample = {(int16_t)i, (int16_t)-i, (int16_t)(i * 3), (uint16_t)(i + 1000)};
+
+    return sample;
+}
+
+static uint8_t Sample_Equal(sample_t a, sample_t b)
+{
+    return (a.x == b.x) && (a.y == b.y) && (a.z == b.z) && (a.time == b.time);
+}
+
+static void Test_U16(void)
+{
+    uint16_t in[TYPED_COUNT];
+    uint16_t out[TYPED_COUNT];
+    uint16_t value;
+
+    Circular_Buffer_U16_Init(&u16_buffer, u16_storage, TYPED_COUNT);
+    TEST_ASSERT(Circular_Buffer_U16_Is_Empty(&u16_buffer));
+    TEST_ASSERT(BUFFER_EMPTY == Circular_Buffer_U16_Read(&u16_buffer, &value));
+    TEST_ASSERT(BUFFER_EMPTY == Circular_Buffer_U16_Peek(&u16_buffer, &value));
+    TEST_ASSERT(0 == Circular_Buffer_U16_Read_Array(&u16_buffer, out, TYPED_COUNT));
+    TEST_ASSERT((TYPED_COUNT - 1) == Circular_Buffer_U16_Available_Space(&u16_buffer));
+
+    // Full with count - 1 elements
+    for (uint16_t i = 0; i < TYPED_COUNT - 1; i++)
+    {
+        TEST_ASSERT(BUFFER_OK == Circular_Buffer_U16_Write(&u16_buffer, 0x8000 + i));
+    }
+    TEST_ASSERT(BUFFER_FULL == Circular_Buffer_U16_Write(&u16_buffer, 0xFFFF));
+    TEST_ASSERT((TYPED_COUNT - 1) == Circular_Buffer_U16_Used_Space(&u16_buffer));
+    TEST_ASSERT(0 == Circular_Buffer_U16_Available_Space(&u16_buffer));
+
+    TEST_ASSERT(BUFFER_OK == Circular_Buffer_U16_Peek(&u16_buffer, &value));
+    TEST_ASSERT(0x8000 == value);
+
+    for (uint16_t i = 0; i < TYPED_COUNT - 1; i++)
+    {
+        TEST_ASSERT(BUFFER_OK == Circular_Buffer_U16_Read(&u16_buffer, &value));
+        TEST_ASSERT((0x8000 + i) == value);
+    }
+    TEST_ASSERT(Circular_Buffer_U16_Is_Empty(&u16_buffer));
+
+    // Indexes at 7: a 5 element array wraps after one element
+    for (uint16_t i = 0; i < TYPED_COUNT; i++)
+    {
+        in[i] = 100 + i;
+    }
+    TEST_ASSERT(BUFFER_OK == Circular_Buffer_U16_Write_Array(&u16_buffer, in, 5));
+    TEST_ASSERT(5 == Circular_Buffer_U16_Used_Space(&u16_buffer));
+    TEST_ASSERT(in[0] == u16_storage[TYPED_COUNT - 1]);
+    TEST_ASSERT(in[1] == u16_storage[0]);
+
+    // Not enough space: nothing written
+    TEST_ASSERT(BUFFER_FULL == Circular_Buffer_U16_Write_Array(&u16_buffer, in, 3));
+    TEST_ASSERT(5 == Circular_Buffer_U16_Used_Space(&u16_buffer));
+    TEST_ASSERT(BUFFER_OK == Circular_Buffer_U16_Write_Array(&u16_buffer, &in[5], 2));
+    TEST_ASSERT(0 == Circular_Buffer_U16_Available_Space(&u16_buffer));
+
+    // Read across the end of storage, shorter than asked
+    memset(out, 0, sizeof(out));
+    TEST_ASSERT(7 == Circular_Buffer_U16_Read_Array(&u16_buffer, out, TYPED_COUNT));
+    TEST_ASSERT(0 == memcmp(in, out, 7 * sizeof(uint16_t)));
+    TEST_ASSERT(Circular_Buffer_U16_Is_Empty(&u16_buffer));
+}
+
+static void Test_U32(void)
+{
+    uint32_t in[TYPED_COUNT];
+    uint32_t out[TYPED_COUNT];
+
+    Circular_Buffer_U32_Init(&u32_buffer, u32_storage, TYPED_COUNT);
+
+    for (uint16_t i = 0; i < TYPED_COUNT; i++)
+    {
+        in[i] = 0xA5A50000UL + i;
+    }
+
+    // Every start position, with a split copy on writes and reads
+    for (uint16_t start = 0; start < TYPED_COUNT; start++)
+    {
+        for (uint16_t length = 1; length < TYPED_COUNT; length++)
+        {
+            TEST_ASSERT(BUFFER_OK == Circular_Buffer_U32_Write_Array(&u32_buffer, in, length));
+            TEST_ASSERT(length == Circular_Buffer_U32_Used_Space(&u32_buffer));
+
+            // Partial reads: 2 elements, then the rest
+            TEST_ASSERT(((length < 2) ? length : 2) == Circular_Buffer_U32_Read_Array(&u32_buffer, out, 2));
+            if (length > 2)
+            {
+                TEST_ASSERT((length - 2) == Circular_Buffer_U32_Read_Array(&u32_buffer, &out[2], TYPED_COUNT));
+            }
+            TEST_ASSERT(0 == memcmp(in, out, length * sizeof(uint32_t)));
+            TEST_ASSERT(Circular_Buffer_U32_Is_Empty(&u32_buffer));
+        }
+
+        // Move the start position by one
+        TEST_ASSERT(BUFFER_OK == Circular_Buffer_U32_Write(&u32_buffer, 0));
+        TEST_ASSERT(1 == Circular_Buffer_U32_Read_Array(&u32_buffer, out, 1));
+    }
+
+    TEST_ASSERT(BUFFER_FULL == Circular_Buffer_U32_Write_Array(&u32_buffer, in, TYPED_COUNT));
+    TEST_ASSERT(Circular_Buffer_U32_Is_Empty(&u32_buffer));
+
+    // Flush drops every element
+    TEST_ASSERT(BUFFER_OK == Circular_Buffer_U32_Write_Array(&u32_buffer, in, 4));
+    Circular_Buffer_U32_Flush(&u32_buffer);
+    TEST_ASSERT(Circular_Buffer_U32_Is_Empty(&u32_buffer));
+}
+
+static void Test_Struct(void)
+{
+    sample_t in[TYPED_COUNT];
+    sample_t out[TYPED_COUNT];
+    sample_t sample;
+
+    Sample_Buffer_Init(&sample_buffer, sample_storage, TYPED_COUNT);
+
+    for (uint16_t i = 0; i < TYPED_COUNT; i++)
+    {
+        in[i] = Sample(i);
+    }
+
+    // Indexes at 6: a 4 element array wraps after two elements
+    for (uint16_t i = 0; i < 6; i++)
+    {
+        TEST_ASSERT(BUFFER_OK == Sample_Buffer_Write(&sample_buffer, in[i]));
+        TEST_ASSERT(BUFFER_OK == Sample_Buffer_Read(&sample_buffer, &sample));
+        TEST_ASSERT(Sample_Equal(in[i], sample));
+    }
+
+    TEST_ASSERT(BUFFER_OK == Sample_Buffer_Write_Array(&sample_buffer, in, 4));
+    TEST_ASSERT(BUFFER_FULL == Sample_Buffer_Write_Array(&sample_buffer, in, 4));
+    TEST_ASSERT(BUFFER_OK == Sample_Buffer_Write_Array(&sample_buffer, &in[4], 3));
+    TEST_ASSERT(BUFFER_FULL == Sample_Buffer_Write(&sample_buffer, in[7]));
+
+    TEST_ASSERT(BUFFER_OK == Sample_Buffer_Peek(&sample_buffer, &sample));
+    TEST_ASSERT(Sample_Equal(in[0], sample));
+
+    TEST_ASSERT(7 == Sample_Buffer_Read_Array(&sample_buffer, out, TYPED_COUNT));
+    for (uint16_t i = 0; i < 7; i++)
+    {
+        TEST_ASSERT(Sample_Equal(in[i], out[i]));
+    }
+    TEST_ASSERT(Sample_Buffer_Is_Empty(&sample_buffer));
+    TEST_ASSERT(BUFFER_EMPTY == Sample_Buffer_Read(&sample_buffer, &sample));
+}
+
+static void Test_Invalid_Size(void)
+{
+    static volatile circular_buffer_t byte_buffer;
+    static uint8_t byte_storage[12];
+
+    TEST_ASSERT(BUFFER_OK == Circular_Buffer_U16_Init(&u16_buffer, u16_storage, TYPED_COUNT));
+    TEST_ASSERT(BUFFER_ERROR == Circular_Buffer_U16_Init(&u16_buffer, u16_storage, TYPED_COUNT - 1));
+    TEST_ASSERT(BUFFER_FULL == Circular_Buffer_U16_Write(&u16_buffer, 1));
+    TEST_ASSERT(0 == Circular_Buffer_U16_Available_Space(&u16_buffer));
+    TEST_ASSERT(BUFFER_ERROR == Circular_Buffer_U32_Init(&u32_buffer, u32_storage, 0));
+    TEST_ASSERT(BUFFER_ERROR == Sample_Buffer_Init(&sample_buffer, sample_storage, 1));
+
+    TEST_ASSERT(BUFFER_OK == Circular_Buffer_Init(&byte_buffer, byte_storage, 8));
+    TEST_ASSERT(BUFFER_ERROR == Circular_Buffer_Init(&byte_buffer, byte_storage, sizeof(byte_storage)));
+    TEST_ASSERT(BUFFER_FULL == Circular_Buffer_Write_Byte(&byte_buffer, 1));
+    TEST_ASSERT(0 == Circular_Buffer_Available_Space(&byte_buffer));
+}
+
+int main(void)
+{
+    Test_U16();
+    Test_U32();
+    Test_Struct();
+    Test_Invalid_Size();
+
+    TEST_PASS("test_circular_typed");
+    return 0;
+}
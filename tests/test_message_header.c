@@ -0,0 +1,214 @@
+/**
+ * @file test_message_header.c
+ *
+ * @brief Round trip of messages through message_buffer_t in each header mode.
+ *
+ *  - Header sizes: 2 bytes (FIXED), 1 byte below 128 and 2 bytes from 128
+ *    (COMPACT), none (NONE).
+ *  - Lengths refused by the mode return BUFFER_ERROR.
+ *  - Random writes and reads, across the wrap of the storage, read back the
+ *    same messages as a model queue, with Read_Message, Peek_Nth_Message,
+ *    Peek_Message_Spans and Read_Batch.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "message_buffer.h"
+#include "test.h"
+
+#define HEADER_BUFFER_SIZE  1024
+#define HEADER_MAX_LENGTH   300
+#define HEADER_RECORD_SIZE  12
+#define HEADER_MODEL_SIZE   1024
+
+typedef struct
+{
+    uint16_t length;
+    uint8_t data[HEADER_MAX_LENGTH];
+} model_message_t;
+
+CIRCULAR_BUFFER_STORAGE(storage, HEADER_BUFFER_SIZE);
+static volatile message_buffer_t buffer;
+static model_message_t model[HEADER_MODEL_SIZE];
+static uint32_t model_first;
+static uint32_t model_last;
+
+static uint8_t Header_Size(message_header_mode_e mode, uint16_t length)
+{
+    switch (mode)
+    {
+        case MESSAGE_HEADER_COMPACT:
+            return (length < 0x80) ? 1 : 2;
+
+        case MESSAGE_HEADER_NONE:
+            return 0;
+
+        default:
+            return 2;
+    }
+}
+
+static void Test_Header_Sizes(message_header_mode_e mode)
+{
+    static const uint16_t lengths[] = {0, 1, 127, 128, 129, 255, 256, 600};
+    uint8_t message[600] = {0};
+    uint8_t read[600];
+    uint16_t length;
+
+    Message_Buffer_Init(&buffer, storage, HEADER_BUFFER_SIZE);
+    Message_Buffer_Set_Header_Mode(&buffer, mode, HEADER_RECORD_SIZE);
+
+    for (uint16_t k = 0; k < sizeof(lengths) / sizeof(lengths[0]); k++)
+    {
+        buffer_status_e status = Message_Buffer_Write_Message(&buffer, message, lengths[k]);
+
+        if ((MESSAGE_HEADER_NONE == mode) && (HEADER_RECORD_SIZE != lengths[k]))
+        {
+            TEST_ASSERT(BUFFER_ERROR == status);
+            continue;
+        }
+
+        TEST_ASSERT(BUFFER_OK == status);
+        TEST_ASSERT(Message_Buffer_Used_Space(&buffer) == lengths[k] + Header_Size(mode, lengths[k]));
+        TEST_ASSERT(BUFFER_OK == Message_Buffer_Read_Message(&buffer, read, &length));
+        TEST_ASSERT(length == lengths[k]);
+        TEST_ASSERT(Message_Buffer_Is_Empty(&buffer));
+        TEST_ASSERT(0 == Message_Buffer_Used_Space(&buffer));
+    }
+
+    if (MESSAGE_HEADER_NONE == mode)
+    {
+        TEST_ASSERT(BUFFER_OK == Message_Buffer_Write_Message(&buffer, message, HEADER_RECORD_SIZE));
+        TEST_ASSERT(HEADER_RECORD_SIZE == Message_Buffer_Used_Space(&buffer));
+    }
+    else if (MESSAGE_HEADER_COMPACT == mode)
+    {
+        TEST_ASSERT(BUFFER_ERROR == Message_Buffer_Write_Message(&buffer, message, MESSAGE_COMPACT_MAX_LENGTH + 1));
+    }
+    else
+    {
+        /* do nothing */
+    }
+}
+
+static void Check_Read(uint8_t * message, uint16_t length)
+{
+    model_message_t * expected = &model[model_first % HEADER_MODEL_SIZE];
+
+    TEST_ASSERT(model_first != model_last);
+    TEST_ASSERT(length == expected->length);
+    TEST_ASSERT(0 == memcmp(message, expected->data, length));
+    model_first++;
+}
+
+static void Test_Round_Trip(message_header_mode_e mode, uint32_t seed)
+{
+    srand(seed);
+    model_first = 0;
+    model_last = 0;
+
+    Message_Buffer_Init(&buffer, storage, HEADER_BUFFER_SIZE);
+    Message_Buffer_Set_Header_Mode(&buffer, mode, HEADER_RECORD_SIZE);
+
+    for (uint32_t it = 0; it < 300000; it++)
+    {
+        uint8_t message[HEADER_MAX_LENGTH * 4];
+        uint16_t lengths[8];
+        uint16_t length;
+        int op = rand() % 6;
+
+        if (op < 3)
+        {
+            model_message_t * next = &model[model_last % HEADER_MODEL_SIZE];
+
+            if (MESSAGE_HEADER_NONE == mode)
+            {
+                next->length = HEADER_RECORD_SIZE;
+            }
+            else
+            {
+                // Both sides of the COMPACT limit
+                next->length = (0 == rand() % 3) ? (rand() % HEADER_MAX_LENGTH) : (120 + rand() % 16);
+            }
+
+            for (uint16_t i = 0; i < next->length; i++)
+            {
+                next->data[i] = (uint8_t)rand();
+            }
+
+            if (BUFFER_OK == Message_Buffer_Write_Message(&buffer, next->data, next->length))
+            {
+                model_last++;
+            }
+            else
+            {
+                TEST_ASSERT(Message_Buffer_Available_Space(&buffer) < next->length + Header_Size(mode, next->length));
+            }
+        }
+        else if (op == 3)
+        {
+            if (BUFFER_OK == Message_Buffer_Read_Message(&buffer, message, &length))
+            {
+                Check_Read(message, length);
+            }
+            else
+            {
+                TEST_ASSERT(model_first == model_last);
+            }
+        }
+        else if (op == 4)
+        {
+            const uint8_t * part1;
+            const uint8_t * part2;
+            uint16_t length1;
+            uint16_t length2;
+
+            if (BUFFER_OK == Message_Buffer_Peek_Message_Spans(&buffer, &part1, &length1, &part2, &length2))
+            {
+                memcpy(message, part1, length1);
+                memcpy(message + length1, part2, length2);
+
+                if (model_last - model_first > 1)
+                {
+                    uint16_t n = rand() % (model_last - model_first);
+
+                    TEST_ASSERT(BUFFER_OK == Message_Buffer_Peek_Nth_Message(&buffer, n, message + length1 + length2, &length));
+                    TEST_ASSERT(length == model[(model_first + n) % HEADER_MODEL_SIZE].length);
+                    TEST_ASSERT(0 == memcmp(message + length1 + length2, model[(model_first + n) % HEADER_MODEL_SIZE].data, length));
+                }
+
+                TEST_ASSERT(BUFFER_OK == Message_Buffer_Drop_Message(&buffer));
+                Check_Read(message, length1 + length2);
+            }
+        }
+        else
+        {
+            uint16_t count = Message_Buffer_Read_Batch(&buffer, message, sizeof(message), lengths, 8);
+            uint16_t offset = 0;
+
+            for (uint16_t i = 0; i < count; i++)
+            {
+                Check_Read(&message[offset], lengths[i]);
+                offset += lengths[i];
+            }
+        }
+
+        TEST_ASSERT(Message_Buffer_Quant_Msg(&buffer) == (model_last - model_first));
+    }
+}
+
+int main(void)
+{
+    Test_Header_Sizes(MESSAGE_HEADER_FIXED);
+    Test_Header_Sizes(MESSAGE_HEADER_COMPACT);
+    Test_Header_Sizes(MESSAGE_HEADER_NONE);
+
+    Test_Round_Trip(MESSAGE_HEADER_FIXED, 1);
+    Test_Round_Trip(MESSAGE_HEADER_COMPACT, 2);
+    Test_Round_Trip(MESSAGE_HEADER_NONE, 3);
+
+    TEST_PASS("test_message_header");
+    return 0;
+}
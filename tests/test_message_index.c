@@ -0,0 +1,151 @@
+/**
+ * @file test_message_index.c
+ *
+ * @brief Randomized test of the message index ring of message_buffer_t.
+ *
+ * Random writes, reads and flushes, with a short index ring
+ * (MESSAGE_INDEX_STACK_SIZE = 8, set by the Makefile) so that both the O(1)
+ * path and the header walk are used. After each operation, every message
+ * returned by Message_Buffer_Peek_Nth_Message/Peek_Last_Message must match a
+ * linear scan of the headers from the oldest message, and a model queue.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "message_buffer.h"
+#include "test.h"
+
+#define INDEX_BUFFER_SIZE   256
+#define INDEX_MAX_LENGTH    40
+#define INDEX_MODEL_SIZE    256     // more than the messages that fit in the buffer
+
+typedef struct
+{
+    uint16_t length;
+    uint8_t data[INDEX_MAX_LENGTH];
+} model_message_t;
+
+CIRCULAR_BUFFER_STORAGE(storage, INDEX_BUFFER_SIZE);
+static volatile message_buffer_t buffer;
+static model_message_t model[INDEX_MODEL_SIZE];
+static uint32_t model_first = 0;
+static uint32_t model_last = 0;
+
+/* Reference: walks the 2 bytes headers from the oldest message */
+static uint16_t Linear_Scan(uint16_t n, uint8_t * message)
+{
+    uint16_t offset = 0;
+    uint8_t header[2];
+    uint16_t length;
+
+    for (uint16_t i = 0; ; i++)
+    {
+        TEST_ASSERT(2 == Circular_Buffer_Peek_Array_Offset(&buffer.data, offset, header, 2));
+        length = ((uint16_t)header[0] << 8) | header[1];
+
+        if (i == n)
+        {
+            break;
+        }
+
+        offset += 2 + length;
+    }
+
+    TEST_ASSERT(length == Circular_Buffer_Peek_Array_Offset(&buffer.data, offset + 2, message, length));
+    return length;
+}
+
+static void Check_All(void)
+{
+    uint16_t quant = Message_Buffer_Quant_Msg(&buffer);
+    uint8_t message[INDEX_MAX_LENGTH];
+    uint8_t scanned[INDEX_MAX_LENGTH];
+    uint16_t length;
+
+    TEST_ASSERT(quant == (model_last - model_first));
+
+    for (uint16_t n = 0; n < quant; n++)
+    {
+        model_message_t * expected = &model[(model_first + n) % INDEX_MODEL_SIZE];
+
+        TEST_ASSERT(BUFFER_OK == Message_Buffer_Peek_Nth_Message(&buffer, n, message, &length));
+        TEST_ASSERT(length == Linear_Scan(n, scanned));
+        TEST_ASSERT(0 == memcmp(message, scanned, length));
+        TEST_ASSERT(length == expected->length);
+        TEST_ASSERT(0 == memcmp(message, expected->data, length));
+    }
+
+    TEST_ASSERT(BUFFER_EMPTY == Message_Buffer_Peek_Nth_Message(&buffer, quant, message, &length));
+
+    if (quant > 0)
+    {
+        model_message_t * expected = &model[(model_last - 1) % INDEX_MODEL_SIZE];
+
+        TEST_ASSERT(BUFFER_OK == Message_Buffer_Peek_Last_Message(&buffer, message, &length));
+        TEST_ASSERT(length == expected->length);
+        TEST_ASSERT(0 == memcmp(message, expected->data, length));
+    }
+    else
+    {
+        TEST_ASSERT(BUFFER_EMPTY == Message_Buffer_Peek_Last_Message(&buffer, message, &length));
+    }
+}
+
+int main(void)
+{
+    srand(8);
+    Message_Buffer_Init(&buffer, storage, INDEX_BUFFER_SIZE);
+
+    for (uint32_t it = 0; it < 200000; it++)
+    {
+        int op = rand() % 16;
+
+        if (op < 9)
+        {
+            model_message_t message;
+
+            // Mostly short messages, so that many more than the ring fit
+            message.length = (rand() % 4 == 0) ? (rand() % INDEX_MAX_LENGTH) : (rand() % 6);
+            for (uint16_t i = 0; i < message.length; i++)
+            {
+                message.data[i] = (uint8_t)rand();
+            }
+
+            if (BUFFER_OK == Message_Buffer_Write_Message(&buffer, message.data, message.length))
+            {
+                model[model_last % INDEX_MODEL_SIZE] = message;
+                model_last++;
+            }
+            else
+            {
+                TEST_ASSERT(Message_Buffer_Available_Space(&buffer) < 2 + message.length);
+            }
+        }
+        else if (op < 15)
+        {
+            uint8_t message[INDEX_MAX_LENGTH];
+            uint16_t length;
+            buffer_status_e status = Message_Buffer_Read_Message(&buffer, message, &length);
+
+            TEST_ASSERT((BUFFER_OK == status) == (model_last != model_first));
+            if (BUFFER_OK == status)
+            {
+                TEST_ASSERT(length == model[model_first % INDEX_MODEL_SIZE].length);
+                TEST_ASSERT(0 == memcmp(message, model[model_first % INDEX_MODEL_SIZE].data, length));
+                model_first++;
+            }
+        }
+        else if (0 == rand() % 8)
+        {
+            Message_Buffer_Flush(&buffer);
+            model_first = model_last;
+        }
+
+        Check_All();
+    }
+
+    TEST_PASS("test_message_index");
+    return 0;
+}
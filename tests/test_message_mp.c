@@ -0,0 +1,219 @@
+/**
+ * @file test_message_mp.c
+ *
+ * @brief Tests of the multi-producer write of message_buffer_t
+ *  (Message_Buffer_Write_Message_MP).
+ *
+ *  - Single thread: random MP writes and reads against a model queue, for more
+ *    than 65536 messages, so the commit slots and the 16 bits claim sequence
+ *    wrap around several times.
+ *  - Threads: four producers write numbered messages with a checked payload
+ *    while the main thread reads them. Each producer's messages must arrive
+ *    complete and in order. Built with MESSAGE_MP_SLOTS = 2 (see the Makefile),
+ *    so producers also run out of commit slots.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "message_buffer.h"
+#include "test.h"
+
+#define MP_BUFFER_SIZE      512
+#define MP_MAX_LENGTH       60
+#define MP_MODEL_SIZE       512
+#define MP_PRODUCERS        4
+
+typedef struct
+{
+    uint16_t length;
+    uint8_t data[MP_MAX_LENGTH];
+} model_message_t;
+
+CIRCULAR_BUFFER_STORAGE(storage, MP_BUFFER_SIZE);
+static volatile message_buffer_t buffer;
+static model_message_t model[MP_MODEL_SIZE];
+static uint32_t messages_per_producer;
+
+static void Test_Single_Thread(void)
+{
+    uint32_t model_first = 0;
+    uint32_t model_last = 0;
+
+    srand(13);
+    Message_Buffer_Init(&buffer, storage, MP_BUFFER_SIZE);
+
+    while (model_last < 200000)
+    {
+        uint8_t message[MP_MAX_LENGTH];
+        uint16_t length;
+
+        if (rand() % 2)
+        {
+            model_message_t * next = &model[model_last % MP_MODEL_SIZE];
+
+            next->length = rand() % MP_MAX_LENGTH;
+            for (uint16_t i = 0; i < next->length; i++)
+            {
+                next->data[i] = (uint8_t)rand();
+            }
+
+            if (BUFFER_OK == Message_Buffer_Write_Message_MP(&buffer, next->data, next->length))
+            {
+                model_last++;
+            }
+            else
+            {
+                TEST_ASSERT(Message_Buffer_Available_Space(&buffer) < 2 + next->length);
+            }
+        }
+        else if (BUFFER_OK == Message_Buffer_Read_Message(&buffer, message, &length))
+        {
+            TEST_ASSERT(length == model[model_first % MP_MODEL_SIZE].length);
+            TEST_ASSERT(0 == memcmp(message, model[model_first % MP_MODEL_SIZE].data, length));
+            model_first++;
+        }
+        else
+        {
+            TEST_ASSERT(model_first == model_last);
+        }
+
+        TEST_ASSERT(Message_Buffer_Quant_Msg(&buffer) == (model_last - model_first));
+
+        if (model_first != model_last)
+        {
+            model_message_t * last = &model[(model_last - 1) % MP_MODEL_SIZE];
+
+            TEST_ASSERT(BUFFER_OK == Message_Buffer_Peek_Last_Message(&buffer, message, &length));
+            TEST_ASSERT(length == last->length);
+            TEST_ASSERT(0 == memcmp(message, last->data, length));
+        }
+    }
+}
+
+static inline uint8_t Payload(uint32_t producer, uint32_t number, uint16_t i)
+{
+    return (uint8_t)((number * 7) + i + producer);
+}
+
+/* Message: producer id, message number (4 bytes), then the checked payload */
+static void * Producer(void * arg)
+{
+    uint32_t producer = (uint32_t)(uintptr_t)arg;
+    uint32_t seed = producer * 77 + 1;
+    uint32_t number = 0;
+
+    while (number < messages_per_producer)
+    {
+        uint8_t message[MP_MAX_LENGTH];
+        uint16_t length;
+        buffer_status_e status;
+
+        seed = seed * 1103515245 + 12345;
+        length = 5 + ((seed >> 16) % (MP_MAX_LENGTH - 5));
+
+        message[0] = (uint8_t)producer;
+        memcpy(&message[1], &number, 4);
+        for (uint16_t i = 5; i < length; i++)
+        {
+            message[i] = Payload(producer, number, i);
+        }
+
+        status = Message_Buffer_Write_Message_MP(&buffer, message, length);
+
+        if (BUFFER_OK == status)
+        {
+            number++;
+        }
+        else
+        {
+            TEST_ASSERT(BUFFER_FULL == status);
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void Check_Message(const uint8_t * message, uint16_t length, uint32_t * next)
+{
+    uint32_t producer = message[0];
+    uint32_t number;
+
+    TEST_ASSERT(length >= 5);
+    TEST_ASSERT(producer < MP_PRODUCERS);
+    memcpy(&number, &message[1], 4);
+    TEST_ASSERT(number == next[producer]);
+
+    for (uint16_t i = 5; i < length; i++)
+    {
+        TEST_ASSERT(message[i] == Payload(producer, number, i));
+    }
+
+    next[producer]++;
+}
+
+static void Test_Producer_Threads(void)
+{
+    pthread_t producers[MP_PRODUCERS];
+    uint32_t next[MP_PRODUCERS] = {0};
+    uint32_t received = 0;
+
+    Message_Buffer_Init(&buffer, storage, MP_BUFFER_SIZE);
+
+    for (uint32_t i = 0; i < MP_PRODUCERS; i++)
+    {
+        TEST_ASSERT(0 == pthread_create(&producers[i], NULL, Producer, (void *)(uintptr_t)i));
+    }
+
+    while (received < MP_PRODUCERS * messages_per_producer)
+    {
+        uint8_t messages[MP_MAX_LENGTH * 8];
+        uint16_t lengths[8];
+        uint16_t count;
+        uint16_t offset = 0;
+
+        if (received & 1)
+        {
+            count = (BUFFER_OK == Message_Buffer_Read_Message(&buffer, messages, &lengths[0])) ? 1 : 0;
+        }
+        else
+        {
+            count = Message_Buffer_Read_Batch(&buffer, messages, sizeof(messages), lengths, 8);
+        }
+
+        if (0 == count)
+        {
+            sched_yield();
+        }
+
+        for (uint16_t k = 0; k < count; k++)
+        {
+            Check_Message(&messages[offset], lengths[k], next);
+            offset += lengths[k];
+        }
+
+        received += count;
+    }
+
+    for (uint32_t i = 0; i < MP_PRODUCERS; i++)
+    {
+        TEST_ASSERT(0 == pthread_join(producers[i], NULL));
+    }
+
+    TEST_ASSERT(Message_Buffer_Is_Empty(&buffer));
+}
+
+int main(int argc, char ** argv)
+{
+    messages_per_producer = (argc > 1) ? strtoul(argv[1], NULL, 0) : 50000;
+
+    Test_Single_Thread();
+    Test_Producer_Threads();
+
+    TEST_PASS("test_message_mp");
+    return 0;
+}
@@ -0,0 +1,222 @@
+/**
+ * @file test_message_reserve.c
+ *
+ * @brief Tests of the zero-copy Reserve/Commit/Abort of message_buffer_t.
+ *
+ *  - The committed message has the header of the mode used to reserve it:
+ *    Set_Header_Mode is refused while a message is reserved, and a Flush does
+ *    not affect the reservation.
+ *  - Write_Message and a second Reserve are refused while a message is
+ *    reserved, Commit is refused without one, Abort writes nothing.
+ *  - Random reservations (committed or aborted), writes and reads, across the
+ *    storage wrap, in each header mode, against a model queue.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "message_buffer.h"
+#include "test.h"
+
+#define RESERVE_BUFFER_SIZE 256
+#define RESERVE_MAX_LENGTH  100
+#define RESERVE_RECORD_SIZE 5
+#define RESERVE_MODEL_SIZE  256
+
+typedef struct
+{
+    uint16_t length;
+    uint8_t data[RESERVE_MAX_LENGTH];
+} model_message_t;
+
+CIRCULAR_BUFFER_STORAGE(storage, RESERVE_BUFFER_SIZE);
+static volatile message_buffer_t buffer;
+static model_message_t model[RESERVE_MODEL_SIZE];
+static uint32_t model_first;
+static uint32_t model_last;
+
+static void Fill_Reserved(const uint8_t * data, uint16_t length, uint8_t * part1, uint16_t length1, uint8_t * part2, uint16_t length2)
+{
+    TEST_ASSERT(length == length1 + length2);
+    memcpy(part1, data, length1);
+    memcpy(part2, data + length1, length2);
+}
+
+static void Test_Header_Mode_Locked(void)
+{
+    const uint8_t payload[RESERVE_RECORD_SIZE] = {0xA1, 0xA2, 0xA3, 0xA4, 0xA5};
+    uint8_t message[RESERVE_MAX_LENGTH];
+    uint8_t * part1;
+    uint8_t * part2;
+    uint16_t length1;
+    uint16_t length2;
+    uint16_t length;
+
+    // COMPACT reservation: 1 byte header, a FIXED header would overwrite payload[0]
+    Message_Buffer_Init(&buffer, storage, RESERVE_BUFFER_SIZE);
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Set_Header_Mode(&buffer, MESSAGE_HEADER_COMPACT, 0));
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Reserve(&buffer, sizeof(payload), &part1, &length1, &part2, &length2));
+    Fill_Reserved(payload, sizeof(payload), part1, length1, part2, length2);
+
+    TEST_ASSERT(BUFFER_ERROR == Message_Buffer_Set_Header_Mode(&buffer, MESSAGE_HEADER_FIXED, 0));
+    TEST_ASSERT(BUFFER_ERROR == Message_Buffer_Set_Header_Mode(&buffer, MESSAGE_HEADER_NONE, RESERVE_RECORD_SIZE));
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Commit(&buffer));
+
+    TEST_ASSERT((1 + sizeof(payload)) == Message_Buffer_Used_Space(&buffer));
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Read_Message(&buffer, message, &length));
+    TEST_ASSERT(sizeof(payload) == length);
+    TEST_ASSERT(0 == memcmp(message, payload, length));
+
+    // Allowed again once committed
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Set_Header_Mode(&buffer, MESSAGE_HEADER_NONE, RESERVE_RECORD_SIZE));
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Reserve(&buffer, RESERVE_RECORD_SIZE, &part1, &length1, &part2, &length2));
+    Fill_Reserved(payload, sizeof(payload), part1, length1, part2, length2);
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Commit(&buffer));
+    TEST_ASSERT(RESERVE_RECORD_SIZE == Message_Buffer_Used_Space(&buffer));
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Read_Message(&buffer, message, &length));
+    TEST_ASSERT(0 == memcmp(message, payload, sizeof(payload)));
+}
+
+static void Test_Flush_Keeps_Reservation(void)
+{
+    const uint8_t payload[3] = {1, 2, 3};
+    uint8_t message[RESERVE_MAX_LENGTH];
+    uint8_t * part1;
+    uint8_t * part2;
+    uint16_t length1;
+    uint16_t length2;
+    uint16_t length;
+
+    Message_Buffer_Init(&buffer, storage, RESERVE_BUFFER_SIZE);
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Write_Message(&buffer, (uint8_t *)"old", 3));
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Reserve(&buffer, sizeof(payload), &part1, &length1, &part2, &length2));
+    Fill_Reserved(payload, sizeof(payload), part1, length1, part2, length2);
+
+    Message_Buffer_Flush(&buffer);
+    TEST_ASSERT(Message_Buffer_Is_Empty(&buffer));
+
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Commit(&buffer));
+    TEST_ASSERT(1 == Message_Buffer_Quant_Msg(&buffer));
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Read_Message(&buffer, message, &length));
+    TEST_ASSERT(sizeof(payload) == length);
+    TEST_ASSERT(0 == memcmp(message, payload, length));
+}
+
+static void Test_Refused_Calls(void)
+{
+    uint8_t * part1;
+    uint8_t * part2;
+    uint16_t length1;
+    uint16_t length2;
+
+    Message_Buffer_Init(&buffer, storage, RESERVE_BUFFER_SIZE);
+    TEST_ASSERT(BUFFER_ERROR == Message_Buffer_Commit(&buffer));
+    TEST_ASSERT(BUFFER_FULL == Message_Buffer_Reserve(&buffer, RESERVE_BUFFER_SIZE, &part1, &length1, &part2, &length2));
+
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Reserve(&buffer, 10, &part1, &length1, &part2, &length2));
+    TEST_ASSERT(BUFFER_ERROR == Message_Buffer_Reserve(&buffer, 10, &part1, &length1, &part2, &length2));
+    TEST_ASSERT(BUFFER_ERROR == Message_Buffer_Write_Message(&buffer, (uint8_t *)"x", 1));
+
+    Message_Buffer_Abort(&buffer);
+    TEST_ASSERT(BUFFER_ERROR == Message_Buffer_Commit(&buffer));
+    TEST_ASSERT(Message_Buffer_Is_Empty(&buffer));
+    TEST_ASSERT(0 == Message_Buffer_Used_Space(&buffer));
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Write_Message(&buffer, (uint8_t *)"x", 1));
+}
+
+static void Test_Random(message_header_mode_e mode, uint32_t seed)
+{
+    srand(seed);
+    model_first = 0;
+    model_last = 0;
+
+    Message_Buffer_Init(&buffer, storage, RESERVE_BUFFER_SIZE);
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Set_Header_Mode(&buffer, mode, RESERVE_RECORD_SIZE));
+
+    for (uint32_t it = 0; it < 300000; it++)
+    {
+        int op = rand() % 4;
+
+        if (op < 2)
+        {
+            model_message_t * next = &model[model_last % RESERVE_MODEL_SIZE];
+            buffer_status_e status;
+
+            next->length = (MESSAGE_HEADER_NONE == mode) ? RESERVE_RECORD_SIZE : (rand() % RESERVE_MAX_LENGTH);
+            for (uint16_t i = 0; i < next->length; i++)
+            {
+                next->data[i] = (uint8_t)rand();
+            }
+
+            if (0 == op)
+            {
+                status = Message_Buffer_Write_Message(&buffer, next->data, next->length);
+            }
+            else
+            {
+                uint8_t * part1;
+                uint8_t * part2;
+                uint16_t length1;
+                uint16_t length2;
+
+                status = Message_Buffer_Reserve(&buffer, next->length, &part1, &length1, &part2, &length2);
+
+                if (BUFFER_OK == status)
+                {
+                    Fill_Reserved(next->data, next->length, part1, length1, part2, length2);
+
+                    if (0 == rand() % 5)
+                    {
+                        Message_Buffer_Abort(&buffer);
+                        status = BUFFER_FULL;
+                    }
+                    else
+                    {
+                        TEST_ASSERT(BUFFER_OK == Message_Buffer_Commit(&buffer));
+                    }
+                }
+            }
+
+            if (BUFFER_OK == status)
+            {
+                model_last++;
+            }
+        }
+        else
+        {
+            uint8_t message[RESERVE_MAX_LENGTH];
+            uint16_t length;
+
+            if (BUFFER_OK == Message_Buffer_Read_Message(&buffer, message, &length))
+            {
+                model_message_t * expected = &model[model_first % RESERVE_MODEL_SIZE];
+
+                TEST_ASSERT(model_first != model_last);
+                TEST_ASSERT(length == expected->length);
+                TEST_ASSERT(0 == memcmp(message, expected->data, length));
+                model_first++;
+            }
+            else
+            {
+                TEST_ASSERT(model_first == model_last);
+            }
+        }
+
+        TEST_ASSERT(Message_Buffer_Quant_Msg(&buffer) == (model_last - model_first));
+    }
+}
+
+int main(void)
+{
+    Test_Header_Mode_Locked();
+    Test_Flush_Keeps_Reservation();
+    Test_Refused_Calls();
+
+    Test_Random(MESSAGE_HEADER_FIXED, 1);
+    Test_Random(MESSAGE_HEADER_COMPACT, 2);
+    Test_Random(MESSAGE_HEADER_NONE, 3);
+
+    TEST_PASS("test_message_reserve");
+    return 0;
+}
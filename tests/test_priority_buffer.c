@@ -0,0 +1,157 @@
+/**
+ * @file test_priority_buffer.c
+ *
+ * @brief Tests of priority_buffer_t.
+ *
+ *  - Priority order: random writes to random levels and reads. Each read must
+ *    come from the highest priority level that has messages, in FIFO order
+ *    inside the level, and Peek must return the message Read returns next.
+ *  - Budgets: filling a low priority level does not take the space of the
+ *    other levels.
+ *  - Invalid level, Flush.
+ *  - A budget that is not a 2^N value is refused, without moving the storage
+ *    of the next levels.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "priority_buffer.h"
+#include "test.h"
+
+#define PRIORITY_MAX_LENGTH 12
+
+static const uint16_t budgets[PRIORITY_BUFFER_LEVELS] = {64, 64, 256, 128};
+static uint8_t storage[64 + 64 + 256 + 128];
+static volatile priority_buffer_t buffer;
+
+/* Message: level, sequence number in the level (2 bytes), filler */
+static buffer_status_e Write(uint8_t level, uint16_t number, uint16_t length)
+{
+    uint8_t message[PRIORITY_MAX_LENGTH] = {0};
+
+    message[0] = level;
+    message[1] = (uint8_t)(number >> 8);
+    message[2] = (uint8_t)number;
+
+    return Priority_Buffer_Write_Message(&buffer, level, message, length);
+}
+
+static void Test_Priority_Order(void)
+{
+    uint16_t written[PRIORITY_BUFFER_LEVELS] = {0};
+    uint16_t read[PRIORITY_BUFFER_LEVELS] = {0};
+
+    srand(14);
+    Priority_Buffer_Init(&buffer, storage, budgets);
+
+    for (uint32_t it = 0; it < 500000; it++)
+    {
+        if (rand() % 3 < 2)
+        {
+            uint8_t level = rand() % PRIORITY_BUFFER_LEVELS;
+
+            if (BUFFER_OK == Write(level, written[level], 3 + rand() % (PRIORITY_MAX_LENGTH - 3)))
+            {
+                written[level]++;
+            }
+        }
+        else
+        {
+            uint8_t peeked[PRIORITY_MAX_LENGTH];
+            uint8_t message[PRIORITY_MAX_LENGTH];
+            uint16_t peeked_length;
+            uint16_t length;
+            uint8_t peeked_level;
+            uint8_t level;
+            buffer_status_e peek_status = Priority_Buffer_Peek_Message(&buffer, peeked, &peeked_length, &peeked_level);
+
+            if (BUFFER_OK == Priority_Buffer_Read_Message(&buffer, message, &length, &level))
+            {
+                TEST_ASSERT(BUFFER_OK == peek_status);
+                TEST_ASSERT(peeked_level == level);
+                TEST_ASSERT(peeked_length == length);
+                TEST_ASSERT(0 == memcmp(peeked, message, length));
+
+                // Every higher priority level is empty
+                for (uint8_t k = 0; k < level; k++)
+                {
+                    TEST_ASSERT(written[k] == read[k]);
+                }
+
+                TEST_ASSERT(message[0] == level);
+                TEST_ASSERT((((uint16_t)message[1] << 8) | message[2]) == read[level]);
+                read[level]++;
+            }
+            else
+            {
+                TEST_ASSERT(BUFFER_EMPTY == peek_status);
+                TEST_ASSERT(Priority_Buffer_Is_Empty(&buffer));
+                TEST_ASSERT(0 == Priority_Buffer_Quant_Msg(&buffer));
+
+                for (uint8_t k = 0; k < PRIORITY_BUFFER_LEVELS; k++)
+                {
+                    TEST_ASSERT(written[k] == read[k]);
+                }
+            }
+        }
+    }
+}
+
+static void Test_Budgets(void)
+{
+    uint16_t count = 0;
+
+    Priority_Buffer_Init(&buffer, storage, budgets);
+
+    // Fill the lowest priority level
+    while (BUFFER_OK == Write(PRIORITY_BUFFER_LEVELS - 1, count, PRIORITY_MAX_LENGTH))
+    {
+        count++;
+    }
+
+    TEST_ASSERT(count == (budgets[PRIORITY_BUFFER_LEVELS - 1] - 1) / (2 + PRIORITY_MAX_LENGTH));
+
+    for (uint8_t level = 0; level < PRIORITY_BUFFER_LEVELS - 1; level++)
+    {
+        TEST_ASSERT(Priority_Buffer_Available_Space(&buffer, level) == budgets[level] - 1);
+        TEST_ASSERT(BUFFER_OK == Write(level, 0, PRIORITY_MAX_LENGTH));
+    }
+
+    TEST_ASSERT(BUFFER_ERROR == Write(PRIORITY_BUFFER_LEVELS, 0, 3));
+    TEST_ASSERT((count + PRIORITY_BUFFER_LEVELS - 1) == Priority_Buffer_Quant_Msg(&buffer));
+
+    Priority_Buffer_Flush(&buffer);
+    TEST_ASSERT(Priority_Buffer_Is_Empty(&buffer));
+    TEST_ASSERT(0 == Priority_Buffer_Quant_Msg(&buffer));
+}
+
+static void Test_Invalid_Budget(void)
+{
+    static const uint16_t invalid[PRIORITY_BUFFER_LEVELS] = {64, 100, 256, 128};
+    static uint8_t invalid_storage[64 + 100 + 256 + 128];
+    uint8_t message[3] = {0xA1, 0xA2, 0xA3};
+
+    TEST_ASSERT(BUFFER_OK == Priority_Buffer_Init(&buffer, storage, budgets));
+    TEST_ASSERT(BUFFER_ERROR == Priority_Buffer_Init(&buffer, invalid_storage, invalid));
+
+    TEST_ASSERT(0 == Priority_Buffer_Available_Space(&buffer, 1));
+    TEST_ASSERT(BUFFER_OK != Priority_Buffer_Write_Message(&buffer, 1, message, 3));
+    TEST_ASSERT(Priority_Buffer_Is_Empty(&buffer));
+
+    // Level 2 starts after the whole budget of level 1 (2 bytes header, then the message)
+    TEST_ASSERT(BUFFER_OK == Priority_Buffer_Write_Message(&buffer, 2, message, 3));
+    TEST_ASSERT(0 == memcmp(&invalid_storage[64 + 100 + 2], message, 3));
+    TEST_ASSERT(Priority_Buffer_Available_Space(&buffer, 2) == invalid[2] - 1 - 5);
+}
+
+int main(void)
+{
+    Test_Priority_Order();
+    Test_Budgets();
+    Test_Invalid_Budget();
+
+    TEST_PASS("test_priority_buffer");
+    return 0;
+}
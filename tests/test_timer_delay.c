@@ -0,0 +1,111 @@
+/**
+ * @file test_timer_delay.c
+ *
+ * @brief Tests of the tick delays (Timer_Delay, Timer_Delay_5us).
+ *
+ *  - In thread mode they sleep: each WFI is woken up by one tick interrupt,
+ *    which Host_WFI simulates by calling SysTick_Handler.
+ *  - In handler mode, or with the interrupts masked, the tick never advances,
+ *    so they must count cycles: a thread runs the DWT cycle counter, and the
+ *    delay must return after the right count of cycles.
+ */
+
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "timer.h"
+#include "test.h"
+
+void SysTick_Handler(void);
+
+static uint32_t wfi_calls;
+static volatile uint8_t cycles_running;
+
+void Host_WFI(void)
+{
+    wfi_calls++;
+    SysTick_Handler();
+}
+
+static void * Cycle_Counter(void * arg)
+{
+    (void)arg;
+
+    while (cycles_running)
+    {
+        DWT->CYCCNT += 64;
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+static void Test_Thread_Mode(void)
+{
+    uint32_t start;
+
+    Timer_Init();
+    wfi_calls = 0;
+    start = Timer_GetSystemTick();
+
+    Timer_Delay(2);
+    TEST_ASSERT((Timer_GetSystemTick() - start) == 2 * TIME_1MS);
+    TEST_ASSERT(wfi_calls == 2 * TIME_1MS);
+
+    Timer_Delay_5us(3);
+    TEST_ASSERT((Timer_GetSystemTick() - start) == 2 * TIME_1MS + 3);
+}
+
+/**
+ * @brief Runs a delay of ticks with the tick stopped, and checks it lasts
+ *  ticks * cycles per tick. The counter thread may run on while this one is
+ *  descheduled, hence the loose upper bound.
+ */
+static void Busy_Delay(uint32_t ticks)
+{
+    uint32_t cycles = ticks * (SystemCoreClock / TIMEBASE);
+    uint32_t tick = Timer_GetSystemTick();
+    uint32_t start = DWT->CYCCNT;
+    uint32_t elapsed;
+
+    Timer_Delay_5us(ticks);
+    elapsed = DWT->CYCCNT - start;
+
+    TEST_ASSERT(tick == Timer_GetSystemTick());
+    TEST_ASSERT(elapsed >= cycles);
+    TEST_ASSERT(elapsed < 2 * cycles);
+}
+
+static void Test_Busy_Wait(void)
+{
+    pthread_t counter;
+
+    Timer_Init();
+    wfi_calls = 0;
+    cycles_running = 1;
+    TEST_ASSERT(0 == pthread_create(&counter, NULL, Cycle_Counter, NULL));
+
+    // Called from an interrupt handler (e.g. a hard timer callback)
+    host_ipsr = 15;
+    Busy_Delay(20);
+    host_ipsr = 0;
+
+    // Called with the interrupts masked
+    __disable_irq();
+    Busy_Delay(20);
+    __enable_irq();
+
+    cycles_running = 0;
+    TEST_ASSERT(0 == pthread_join(counter, NULL));
+    TEST_ASSERT(0 == wfi_calls);
+}
+
+int main(void)
+{
+    Test_Thread_Mode();
+    Test_Busy_Wait();
+
+    TEST_PASS("test_timer_delay");
+    return 0;
+}
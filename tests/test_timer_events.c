@@ -0,0 +1,245 @@
+/**
+ * @file test_timer_events.c
+ *
+ * @brief Tests of the soft timer event queue (Timer_SM) and of the hard timers.
+ *
+ * The tick interrupt (SysTick_Handler) is called by the test, and Timer_SM
+ * only when the test wants the main loop to run, so expirations can be left
+ * queued. Timer_Stop, Timer_Start and Timer_Delete must cancel them, also
+ * when called from the timer callback.
+ */
+
+#include <stdint.h>
+
+#include "timer.h"
+#include "test.h"
+
+#define EVENTS_PERIOD   10
+
+void SysTick_Handler(void);
+
+static uint32_t calls;
+static uint32_t periods_sum;
+static uint32_t last_tick;
+static uint8_t in_interrupt;
+static uint8_t called_in_interrupt;
+
+static void Callback(void * ptr, uint32_t periods)
+{
+    calls++;
+    periods_sum += periods;
+    last_tick = *(uint32_t *)ptr;
+    called_in_interrupt = in_interrupt;
+}
+
+static void Ticks(uint32_t count)
+{
+    in_interrupt = 1;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        SysTick_Handler();
+    }
+
+    in_interrupt = 0;
+}
+
+static uint16_t Setup(timer_catchup_t catchup)
+{
+    uint16_t id;
+
+    Timer_Init();
+    calls = 0;
+    periods_sum = 0;
+
+    id = Timer_Create(Callback, AUTO_RELOAD_TIMER, EVENTS_PERIOD);
+    TEST_ASSERT(id < UINT16_MAX);
+    Timer_Set_Catchup(id, catchup);
+
+    return id;
+}
+
+static void Test_Fire_All(void)
+{
+    Setup(TIMER_CATCHUP_FIRE_ALL);
+
+    // One queued event and two missed expirations
+    Ticks(3 * EVENTS_PERIOD + 5);
+    TEST_ASSERT(0 == calls);
+    Timer_SM();
+    TEST_ASSERT(3 == calls);
+    TEST_ASSERT(3 == periods_sum);
+    TEST_ASSERT(0 == called_in_interrupt);
+
+    Timer_SM();
+    TEST_ASSERT(3 == calls);
+}
+
+static void Test_Stop_Cancels(void)
+{
+    uint16_t id = Setup(TIMER_CATCHUP_FIRE_ALL);
+
+    Ticks(3 * EVENTS_PERIOD);
+    Timer_Stop(id);
+    Timer_SM();
+    TEST_ASSERT(0 == calls);
+    TEST_ASSERT(TIMER_STOPPED == Timer_GetTimerState(id));
+
+    // Nothing left behind for the next start
+    Timer_Start(id);
+    Ticks(EVENTS_PERIOD);
+    Timer_SM();
+    TEST_ASSERT(1 == calls);
+}
+
+static void Test_Restart_Cancels(void)
+{
+    uint16_t id = Setup(TIMER_CATCHUP_FIRE_ALL);
+
+    Ticks(3 * EVENTS_PERIOD);
+    Timer_Stop(id);
+    Timer_Start(id);
+
+    // The stale event is still queued: these expirations are counted as missed
+    Ticks(2 * EVENTS_PERIOD);
+    Timer_SM();
+    TEST_ASSERT(2 == calls);
+    TEST_ASSERT(last_tick == Timer_GetSystemTick());
+
+    Ticks(EVENTS_PERIOD);
+    Timer_SM();
+    TEST_ASSERT(3 == calls);
+    TEST_ASSERT(last_tick == Timer_GetSystemTick());
+
+    // Restarted while running, without Timer_Stop
+    Ticks(EVENTS_PERIOD);
+    Timer_Start(id);
+    Timer_SM();
+    TEST_ASSERT(3 == calls);
+}
+
+static void Test_Report_After_Restart(void)
+{
+    uint16_t id = Setup(TIMER_CATCHUP_REPORT);
+
+    Ticks(4 * EVENTS_PERIOD);
+    Timer_Start(id);
+    Ticks(3 * EVENTS_PERIOD);
+    Timer_SM();
+    TEST_ASSERT(1 == calls);
+    TEST_ASSERT(3 == periods_sum);
+}
+
+static void Test_Delete_Cancels(void)
+{
+    uint16_t id = Setup(TIMER_CATCHUP_FIRE_ALL);
+
+    Ticks(2 * EVENTS_PERIOD);
+    Timer_Delete(id);
+    TEST_ASSERT(TIMER_EMPTY == Timer_GetTimerState(id));
+
+    // The slot is kept until its queued event is drained
+    TEST_ASSERT(id != Timer_Create(Callback, ONE_SHOT_TIMER, EVENTS_PERIOD));
+    Timer_SM();
+    TEST_ASSERT(0 == calls);
+}
+
+static uint16_t self_id;
+static uint32_t self_calls;
+static uint8_t self_restart;
+
+static void Stop_Self_Callback(void * ptr, uint32_t periods)
+{
+    (void)ptr;
+    (void)periods;
+
+    self_calls++;
+
+    if (self_restart)
+    {
+        Timer_Start(self_id);
+    }
+    else
+    {
+        Timer_Stop(self_id);
+    }
+}
+
+static void Test_Callback_Cancels(void)
+{
+    // Stopped from its own callback, with missed expirations left
+    Timer_Init();
+    self_calls = 0;
+    self_restart = 0;
+    self_id = Timer_Create(Stop_Self_Callback, AUTO_RELOAD_TIMER, EVENTS_PERIOD);
+    TEST_ASSERT(self_id < UINT16_MAX);
+
+    Ticks(4 * EVENTS_PERIOD);
+    Timer_SM();
+    TEST_ASSERT(1 == self_calls);
+    TEST_ASSERT(TIMER_STOPPED == Timer_GetTimerState(self_id));
+
+    Ticks(4 * EVENTS_PERIOD);
+    Timer_SM();
+    TEST_ASSERT(1 == self_calls);
+
+    // Restarted from its own callback: one call, then one per new period
+    self_restart = 1;
+    Timer_Start(self_id);
+    Ticks(4 * EVENTS_PERIOD);
+    Timer_SM();
+    TEST_ASSERT(2 == self_calls);
+
+    Ticks(EVENTS_PERIOD);
+    Timer_SM();
+    TEST_ASSERT(3 == self_calls);
+
+    // Another timer is not affected
+    Setup(TIMER_CATCHUP_FIRE_ALL);
+    Ticks(3 * EVENTS_PERIOD);
+    Timer_SM();
+    TEST_ASSERT(3 == calls);
+}
+
+static void Test_One_Shot(void)
+{
+    uint16_t id;
+
+    Timer_Init();
+    calls = 0;
+    id = Timer_Create(Callback, ONE_SHOT_TIMER, EVENTS_PERIOD);
+
+    Ticks(5 * EVENTS_PERIOD);
+    Timer_SM();
+    TEST_ASSERT(1 == calls);
+    TEST_ASSERT(TIMER_STOPPED == Timer_GetTimerState(id));
+}
+
+static void Test_Hard(void)
+{
+    uint16_t id = Setup(TIMER_CATCHUP_FIRE_ALL);
+
+    Timer_Set_Hard(id, 1);
+    Ticks(EVENTS_PERIOD);
+    TEST_ASSERT(1 == calls);
+    TEST_ASSERT(1 == called_in_interrupt);
+    TEST_ASSERT(last_tick == Timer_GetSystemTick());
+
+    Timer_SM();
+    TEST_ASSERT(1 == calls);
+}
+
+int main(void)
+{
+    Test_Fire_All();
+    Test_Stop_Cancels();
+    Test_Restart_Cancels();
+    Test_Report_After_Restart();
+    Test_Delete_Cancels();
+    Test_Callback_Cancels();
+    Test_One_Shot();
+    Test_Hard();
+
+    TEST_PASS("test_timer_events");
+    return 0;
+}
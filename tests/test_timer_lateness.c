@@ -0,0 +1,185 @@
+/**
+ * @file test_timer_lateness.c
+ *
+ * @brief Host simulation of the firing lateness of the software timers.
+ *
+ * Auto-reload timers with random periods run for a while. Each main loop pass
+ * does some work, which lasts a pseudo-random count of ticks (SysTick_Handler
+ * calls) from a seeded sequence, then calls Timer_SM. The lateness of a
+ * callback is the tick when it runs minus the tick when its timer expired.
+ *
+ * The same timers and the same loop also go through a model of the previous
+ * Timer_SM, which checked one timer slot per call (round-robin), to compare
+ * both schemes with 20 and TMR_AMOUNT (200, see the Makefile) timers, with one
+ * tick per pass and with 0 to LATENESS_MAX_GAP ticks per pass. With 200 slots
+ * the round-robin falls behind for good: the timers of period below 200 passes
+ * expire faster than their slot is checked. With the current scheduler a
+ * callback is never later than the ticks since the previous Timer_SM call.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "timer.h"
+#include "test.h"
+
+#define LATENESS_TICKS  1000000UL
+#define LATENESS_MAX_GAP 16         // below the shortest period: one expiration per pass at most
+
+void SysTick_Handler(void);
+
+typedef struct
+{
+    uint32_t timeout;
+    uint32_t period;
+} lateness_timer_t;
+
+typedef struct
+{
+    uint64_t sum;
+    uint64_t fired;
+    uint32_t max;
+} lateness_t;
+
+static lateness_timer_t expected[TMR_AMOUNT];
+static uint16_t timers_running;
+static lateness_t current;
+static uint32_t current_gap;    // ticks since the previous Timer_SM call
+static uint32_t gap_state;
+
+static void Record(lateness_t * lateness, uint32_t late)
+{
+    lateness->sum += late;
+    lateness->fired++;
+
+    if (late > lateness->max)
+    {
+        lateness->max = late;
+    }
+}
+
+/* The callback has no timer id: take a timer expected at this tick */
+static void Timer_Callback(void * ptr, uint32_t periods)
+{
+    uint32_t tick = *(uint32_t *)ptr;
+    uint16_t i;
+
+    TEST_ASSERT(1 == periods);
+
+    for (i = 0; (i < timers_running) && (expected[i].timeout != tick); i++)
+    {
+        /* do nothing */
+    }
+
+    TEST_ASSERT(i < timers_running);
+    TEST_ASSERT((Timer_GetSystemTick() - expected[i].timeout) <= current_gap);
+    Record(&current, Timer_GetSystemTick() - expected[i].timeout);
+    expected[i].timeout += expected[i].period;
+}
+
+/* Ticks of work of the next main loop pass, the same sequence for both schemes */
+static uint32_t Gap(uint32_t min_gap, uint32_t max_gap)
+{
+    gap_state = gap_state * 1103515245UL + 12345UL;
+    return min_gap + ((gap_state >> 16) % (max_gap - min_gap + 1));
+}
+
+static void Start_Timers(uint16_t count, uint32_t seed)
+{
+    srand(seed);
+    timers_running = count;
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        expected[i].period = 20 + (rand() % 2000);
+        expected[i].timeout = Timer_GetSystemTick() + expected[i].period;
+        TEST_ASSERT(i == Timer_Create(Timer_Callback, AUTO_RELOAD_TIMER, expected[i].period));
+    }
+}
+
+/* Current scheduler: every due timer fires from the tick interrupt */
+static lateness_t Run_Current(uint16_t count, uint32_t min_gap, uint32_t max_gap)
+{
+    uint32_t t = 0;
+
+    current = (lateness_t){0, 0, 0};
+    gap_state = count;
+    Timer_Init();
+    Start_Timers(count, count);
+
+    while (t < LATENESS_TICKS)
+    {
+        current_gap = Gap(min_gap, max_gap);
+
+        for (uint32_t i = 0; i < current_gap; i++)
+        {
+            SysTick_Handler();
+        }
+
+        t += current_gap;
+        Timer_SM();
+    }
+
+    return current;
+}
+
+/* Previous scheduler, with a pool of count timers: Timer_SM checked timer
+ * timer_cnt only, then moved to the next slot */
+static lateness_t Run_Round_Robin(uint16_t count, uint32_t min_gap, uint32_t max_gap)
+{
+    lateness_t previous = {0, 0, 0};
+    uint16_t timer_cnt = 0;
+    uint32_t tick = 0;
+
+    srand(count);
+    gap_state = count;
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        expected[i].period = 20 + (rand() % 2000);
+        expected[i].timeout = expected[i].period;
+    }
+
+    while (tick < LATENESS_TICKS)
+    {
+        tick += Gap(min_gap, max_gap);
+
+        if (tick >= expected[timer_cnt].timeout)
+        {
+            Record(&previous, tick - expected[timer_cnt].timeout);
+            expected[timer_cnt].timeout += expected[timer_cnt].period;
+        }
+
+        if (count <= (++timer_cnt))
+        {
+            timer_cnt = 0;
+        }
+    }
+
+    return previous;
+}
+
+static void Compare(uint16_t count, uint32_t min_gap, uint32_t max_gap)
+{
+    lateness_t previous = Run_Round_Robin(count, min_gap, max_gap);
+    lateness_t now = Run_Current(count, min_gap, max_gap);
+
+    printf("%3u timers, %2lu-%2lu ticks per pass: round-robin avg %9.2f max %6lu, min-heap avg %5.2f max %2lu ticks (%llu callbacks)\n",
+           count, (unsigned long)min_gap, (unsigned long)max_gap,
+           (double)previous.sum / previous.fired, (unsigned long)previous.max,
+           (double)now.sum / now.fired, (unsigned long)now.max, (unsigned long long)now.fired);
+
+    TEST_ASSERT(now.fired > 0);
+    TEST_ASSERT(now.max <= max_gap);
+}
+
+int main(void)
+{
+    Compare(20, 1, 1);
+    Compare(TMR_AMOUNT, 1, 1);
+    Compare(20, 0, LATENESS_MAX_GAP);
+    Compare(TMR_AMOUNT, 0, LATENESS_MAX_GAP);
+
+    TEST_PASS("test_timer_lateness");
+    return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file test_uart_baud.c
+ *
+ * @brief Baud rate table test of Uart_Solve_Baud.
+ *
+ * For the standard rates from 1200 to 4.5 Mbaud, on USART1 (PCLK2) and
+ * USART2/3 (PCLK1) with two RCC configurations (72 MHz and 64 MHz SYSCLK):
+ *  - the BRR value is the one with the smallest baud error, found by trying
+ *    all of them (16 to 0xFFFF),
+ *  - the achieved baud rate and the ppm error match that BRR,
+ *  - the rates the port clock cannot reach (above PCLK/16, below PCLK/65535)
+ *    are refused.
+ */
+
+#include <stdint.h>
+
+#include "uart.h"
+#include "test.h"
+
+static const uint32_t rates[] =
+{
+    1200, 2400, 4800, 9600, 14400, 19200, 28800, 38400, 57600, 76800,
+    115200, 128000, 230400, 250000, 256000, 460800, 500000, 921600,
+    1000000, 1500000, 2000000, 2250000, 3000000, 4000000, 4500000,
+};
+
+/**
+ * @brief BRR with the smallest |pclk / brr - baud|, 0 if none is in range.
+ */
+static uint32_t Best_BRR(uint32_t pclk, uint32_t baud)
+{
+    uint64_t best_diff = 0;
+    uint32_t best = 0;
+
+    for (uint32_t brr = 16; brr <= 0xFFFF; brr++)
+    {
+        uint64_t product = (uint64_t)baud * brr;
+        uint64_t diff = (product > pclk) ? (product - pclk) : (pclk - product);
+
+        // diff / brr < best_diff / best
+        if (!best || (diff * best < best_diff * brr))
+        {
+            best = brr;
+            best_diff = diff;
+        }
+    }
+
+    return best;
+}
+
+static void Check_Port(USART_TypeDef *uart, uint32_t pclk)
+{
+    for (uint32_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        uint32_t baud = rates[i];
+        uart_baud_t solved;
+        uart_status_e status = Uart_Solve_Baud(uart, baud, &solved);
+        int64_t error_ppm;
+
+        if (baud > pclk / 16)
+        {
+            TEST_ASSERT(UART_ERR == status);
+            continue;
+        }
+
+        TEST_ASSERT(UART_OK == status);
+        TEST_ASSERT(solved.brr == Best_BRR(pclk, baud));
+
+        // Achieved rate and error, to the nearest unit
+        TEST_ASSERT(solved.baud == (pclk + solved.brr / 2) / solved.brr);
+
+        error_ppm = ((int64_t)pclk - (int64_t)baud * solved.brr) * 1000000
+                    / ((int64_t)baud * solved.brr);
+        TEST_ASSERT((solved.error_ppm - error_ppm) <= 1);
+        TEST_ASSERT((error_ppm - solved.error_ppm) <= 1);
+    }
+}
+
+static void Test_72MHz(void)
+{
+    uart_baud_t solved;
+
+    // HSE 8 MHz x 9, APB1 / 2: PCLK2 72 MHz, PCLK1 36 MHz
+    RCC->CFGR = RCC_CFGR_SWS_PLL | RCC_CFGR_PLLSRC | RCC_CFGR_PLLMULL9 | RCC_CFGR_PPRE1_DIV2;
+
+    Check_Port(USART1, 72000000);
+    Check_Port(USART2, 36000000);
+
+    // Exact rates
+    TEST_ASSERT(UART_OK == Uart_Solve_Baud(USART1, 115200, &solved));
+    TEST_ASSERT(0x271 == solved.brr && 115200 == solved.baud && 0 == solved.error_ppm);
+    TEST_ASSERT(UART_OK == Uart_Solve_Baud(USART1, 4500000, &solved));
+    TEST_ASSERT(0x10 == solved.brr && 0 == solved.error_ppm);
+
+    // 312.5 on PCLK1: 313 is the closer rate
+    TEST_ASSERT(UART_OK == Uart_Solve_Baud(USART2, 115200, &solved));
+    TEST_ASSERT(313 == solved.brr && solved.error_ppm < 0);
+
+    // Out of range: BRR above 0xFFFF or below 16, or no rate
+    TEST_ASSERT(UART_ERR == Uart_Solve_Baud(USART1, 1000, &solved));
+    TEST_ASSERT(UART_ERR == Uart_Solve_Baud(USART2, 4500000, &solved));
+    TEST_ASSERT(UART_ERR == Uart_Solve_Baud(USART1, 0, &solved));
+}
+
+static void Test_64MHz(void)
+{
+    // HSI / 2 x 16, APB1 / 2: PCLK2 64 MHz, PCLK1 32 MHz
+    RCC->CFGR = RCC_CFGR_SWS_PLL | RCC_CFGR_PLLMULL16 | RCC_CFGR_PPRE1_DIV2;
+
+    Check_Port(USART1, 64000000);
+    Check_Port(USART3, 32000000);
+}
+
+int main(void)
+{
+    Test_72MHz();
+    Test_64MHz();
+
+    TEST_PASS("test_uart_baud");
+    return 0;
+}
@@ -0,0 +1,281 @@
+/**
+ * @file test_uart_dma.c
+ *
+ * @brief Tests of the USART1 DMA transmission on the simulated registers.
+ *
+ * Dma_Step plays the DMA1 channel 4: if the channel is enabled, it either moves
+ * CNDTR bytes from CMAR to the line (TC) or fails (TE, the channel is disabled
+ * by hardware), then calls the DMA interrupt. Checked:
+ *  - queued arrays are sent in order, with one TX callback each, and the queue
+ *    is refused when full,
+ *  - a message that wraps the buffer storage is sent by two transfers and
+ *    removed from the buffer once sent,
+ *  - a transfer error is reported to the error callback and counted, not to
+ *    the TX callback, the next transfer is still sent, and a failed message
+ *    (either part of a wrapped one) is left in the buffer.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "uart.h"
+#include "test.h"
+
+#define DMA_TX_SHIFT    12      // DMA1 channel 4 flags in ISR/IFCR
+
+void DMA1_Channel4_IRQHandler(void);
+
+static uint8_t line[256];
+static uint16_t line_length;
+
+static const uint8_t *tx_data[16];
+static uint16_t tx_length[16];
+static uint16_t tx_calls;
+
+static uint8_t error_flags;
+static uint16_t error_calls;
+
+static void TX_Callback(const uint8_t *data, uint16_t length)
+{
+    tx_data[tx_calls] = data;
+    tx_length[tx_calls] = length;
+    tx_calls++;
+}
+
+static void Error_Callback(uint8_t errors)
+{
+    error_flags |= errors;
+    error_calls++;
+}
+
+/**
+ * @brief Runs the enabled transfer, if any, to its end (or to an error if
+ *  fail is set). Returns 0 if the channel was disabled.
+ */
+static uint8_t Dma_Step(uint8_t fail)
+{
+    DMA_Channel_TypeDef *channel = DMA1_Channel4;
+
+    if (0 == (channel->CCR & DMA_CCR_EN))
+    {
+        return 0;
+    }
+
+    TEST_ASSERT(channel->CPAR == (uint32_t)&USART1->DR);
+
+    if (fail)
+    {
+        channel->CCR &= ~DMA_CCR_EN;
+        DMA1->ISR |= (DMA_ISR_TEIF1 | DMA_ISR_GIF1) << DMA_TX_SHIFT;
+    }
+    else
+    {
+        memcpy(&line[line_length], (const uint8_t *)(uintptr_t)channel->CMAR, channel->CNDTR);
+        line_length += channel->CNDTR;
+        channel->CNDTR = 0;
+        DMA1->ISR |= (DMA_ISR_TCIF1 | DMA_ISR_GIF1) << DMA_TX_SHIFT;
+    }
+
+    DMA1->IFCR = 0;
+    DMA1_Channel4_IRQHandler();
+
+    // The flags must be cleared, otherwise the interrupt keeps firing
+    TEST_ASSERT(DMA1->IFCR == (DMA_IFCR_CGIF1 << DMA_TX_SHIFT));
+    DMA1->ISR = 0;
+
+    return 1;
+}
+
+static void Dma_Run_All(void)
+{
+    while (Dma_Step(0))
+    {
+    }
+}
+
+static void Reset(void)
+{
+    Host_Reset();
+    USART1->CR1 = USART_CR1_UE | USART_CR1_TE;
+
+    Uart_Set_TX_Callback(USART1, TX_Callback);
+    Uart_Set_Error_Callback(USART1, Error_Callback);
+    Uart_Clear_Errors(USART1);
+
+    line_length = 0;
+    tx_calls = 0;
+    error_flags = 0;
+    error_calls = 0;
+}
+
+/**
+ * @brief Fills msg_buffer so that its first message wraps the end of storage.
+ */
+static void Wrapped_Message(volatile message_buffer_t *msg_buffer, uint8_t *storage, uint8_t *message)
+{
+    uint8_t read[32];
+    uint16_t length;
+
+    for (uint16_t i = 0; i < 20; i++)
+    {
+        message[i] = 'a' + i;
+    }
+
+    Message_Buffer_Init(msg_buffer, storage, 32);
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Write_Message(msg_buffer, message, 20));
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Read_Message(msg_buffer, read, &length));
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Write_Message(msg_buffer, message, 20));
+}
+
+static void Test_Arrays(void)
+{
+    static const uint8_t hello[] = "hello ";
+    static const uint8_t world[] = "world";
+    static const uint8_t bang[] = "!!";
+
+    Reset();
+
+    TEST_ASSERT(UART_OK == Uart_Write_Array_DMA(USART1, hello, 6));
+    TEST_ASSERT(USART1->CR3 & USART_CR3_DMAT);
+    TEST_ASSERT(RCC->AHBENR & RCC_AHBENR_DMA1EN);
+    TEST_ASSERT(UART_OK == Uart_Write_Array_DMA(USART1, world, 5));
+    TEST_ASSERT(UART_OK == Uart_Write_Array_DMA(USART1, bang, 2));
+
+    // UART_DMA_TX_QUEUE - 1 transfers can be queued
+    TEST_ASSERT(UART_ERR == Uart_Write_Array_DMA(USART1, bang, 1));
+    TEST_ASSERT(Uart_TX_DMA_Busy(USART1));
+
+    Dma_Run_All();
+    TEST_ASSERT(13 == line_length);
+    TEST_ASSERT(0 == memcmp(line, "hello world!!", 13));
+    TEST_ASSERT(3 == tx_calls);
+    TEST_ASSERT(hello == tx_data[0] && 6 == tx_length[0]);
+    TEST_ASSERT(world == tx_data[1] && 5 == tx_length[1]);
+    TEST_ASSERT(!Uart_TX_DMA_Busy(USART1));
+    TEST_ASSERT(0 == error_calls);
+
+    // The USART must be enabled
+    TEST_ASSERT(UART_ERR == Uart_Write_Array_DMA(USART3, hello, 6));
+}
+
+static void Test_Message(void)
+{
+    static uint8_t storage[32];
+    static volatile message_buffer_t msg_buffer;
+    static uint8_t message[20];
+    static const uint8_t x[] = "x";
+
+    Reset();
+    Wrapped_Message(&msg_buffer, storage, message);
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Write_Message(&msg_buffer, (uint8_t *)"zz", 2));
+
+    TEST_ASSERT(UART_OK == Uart_Write_Message_DMA(USART1, &msg_buffer));
+    // One message at a time
+    TEST_ASSERT(UART_ERR == Uart_Write_Message_DMA(USART1, &msg_buffer));
+    TEST_ASSERT(UART_OK == Uart_Write_Array_DMA(USART1, x, 1));
+
+    Dma_Run_All();
+    TEST_ASSERT(21 == line_length);
+    TEST_ASSERT(0 == memcmp(line, message, 20) && 'x' == line[20]);
+    TEST_ASSERT(2 == tx_calls);
+    TEST_ASSERT(NULL == tx_data[0] && 20 == tx_length[0]);
+    TEST_ASSERT(x == tx_data[1] && 1 == tx_length[1]);
+    TEST_ASSERT(1 == Message_Buffer_Quant_Msg(&msg_buffer));
+
+    TEST_ASSERT(UART_OK == Uart_Write_Message_DMA(USART1, &msg_buffer));
+    Dma_Run_All();
+    TEST_ASSERT(23 == line_length && 0 == memcmp(&line[21], "zz", 2));
+    TEST_ASSERT(Message_Buffer_Is_Empty(&msg_buffer));
+    TEST_ASSERT(UART_ERR == Uart_Write_Message_DMA(USART1, &msg_buffer));
+}
+
+static void Test_Array_Error(void)
+{
+    static const uint8_t bad[] = "bad";
+    static const uint8_t good[] = "good";
+    uart_errors_t errors;
+
+    Reset();
+
+    TEST_ASSERT(UART_OK == Uart_Write_Array_DMA(USART1, bad, 3));
+    TEST_ASSERT(UART_OK == Uart_Write_Array_DMA(USART1, good, 4));
+
+    TEST_ASSERT(Dma_Step(1));
+    TEST_ASSERT(1 == error_calls);
+    TEST_ASSERT(UART_ERROR_DMA_TX == error_flags);
+    TEST_ASSERT(0 == tx_calls);
+    TEST_ASSERT(Uart_TX_DMA_Busy(USART1));
+
+    Dma_Run_All();
+    TEST_ASSERT(4 == line_length && 0 == memcmp(line, "good", 4));
+    TEST_ASSERT(1 == tx_calls && good == tx_data[0]);
+    TEST_ASSERT(!Uart_TX_DMA_Busy(USART1));
+
+    Uart_Get_Errors(USART1, &errors);
+    TEST_ASSERT(1 == errors.dma_tx);
+    TEST_ASSERT(0 == errors.overrun);
+    Uart_Clear_Errors(USART1);
+    Uart_Get_Errors(USART1, &errors);
+    TEST_ASSERT(0 == errors.dma_tx);
+    TEST_ASSERT(0 == host_primask);
+
+    // Called with the interrupts disabled, they stay disabled
+    __disable_irq();
+    Uart_Clear_Errors(USART1);
+    TEST_ASSERT(1 == host_primask);
+    __enable_irq();
+}
+
+static void Test_Message_Error(void)
+{
+    static uint8_t storage[32];
+    static volatile message_buffer_t msg_buffer;
+    static uint8_t message[20];
+    static const uint8_t x[] = "x";
+
+    Reset();
+    Message_Buffer_Init(&msg_buffer, storage, 32);
+    TEST_ASSERT(BUFFER_OK == Message_Buffer_Write_Message(&msg_buffer, (uint8_t *)"abc", 3));
+
+    // Failed message: left in the buffer, and can be sent again
+    TEST_ASSERT(UART_OK == Uart_Write_Message_DMA(USART1, &msg_buffer));
+    TEST_ASSERT(Dma_Step(1));
+    TEST_ASSERT(1 == error_calls && 0 == tx_calls);
+    TEST_ASSERT(1 == Message_Buffer_Quant_Msg(&msg_buffer));
+
+    TEST_ASSERT(UART_OK == Uart_Write_Message_DMA(USART1, &msg_buffer));
+    Dma_Run_All();
+    TEST_ASSERT(3 == line_length && 0 == memcmp(line, "abc", 3));
+    TEST_ASSERT(1 == tx_calls && NULL == tx_data[0]);
+    TEST_ASSERT(Message_Buffer_Is_Empty(&msg_buffer));
+
+    // Failed first part of a wrapped message: the second part is not sent
+    Reset();
+    Wrapped_Message(&msg_buffer, storage, message);
+
+    TEST_ASSERT(UART_OK == Uart_Write_Message_DMA(USART1, &msg_buffer));
+    TEST_ASSERT(UART_OK == Uart_Write_Array_DMA(USART1, x, 1));
+    TEST_ASSERT(Dma_Step(1));
+    TEST_ASSERT(1 == error_calls);
+
+    Dma_Run_All();
+    TEST_ASSERT(1 == line_length && 'x' == line[0]);
+    TEST_ASSERT(1 == tx_calls && x == tx_data[0]);
+    TEST_ASSERT(1 == Message_Buffer_Quant_Msg(&msg_buffer));
+
+    TEST_ASSERT(UART_OK == Uart_Write_Message_DMA(USART1, &msg_buffer));
+    Dma_Run_All();
+    TEST_ASSERT(21 == line_length && 0 == memcmp(&line[1], message, 20));
+    TEST_ASSERT(Message_Buffer_Is_Empty(&msg_buffer));
+}
+
+int main(void)
+{
+    Test_Arrays();
+    Test_Message();
+    Test_Array_Error();
+    Test_Message_Error();
+
+    TEST_PASS("test_uart_dma");
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "stm32f1xx.h"
 #include "timer.h"
+#include "circular_buffer_typed.h"
 
 #ifndef NULL
 #define NULL ((void *)0x00)
@@ -17,6 +18,13 @@
 #define TMR_AMOUNT    20
 #endif
 
+/* Event queue of the soft timers, 2^N and greater than TMR_AMOUNT */
+#ifndef TMR_EVENT_AMOUNT
+#define TMR_EVENT_AMOUNT    32
+#endif
+
+#define TMR_NOT_QUEUED    UINT16_MAX
+
 typedef struct timer
 {
     timer_callback_t cbk;
@@ -24,14 +32,82 @@ typedef struct timer
     uint32_t period;
     uint32_t timeout;
     timer_state_t state;
+    uint16_t heap_pos;
+    timer_catchup_t catchup;
+    uint8_t hard;
+    uint8_t event_pending;
+    uint8_t event_cancelled;
+    uint32_t missed;
 }
 timer_t;
 
-static timer_t timers[TMR_AMOUNT] = {{NULL, TYPE_NOT_DEFINED, 0, 0, TIMER_EMPTY}};
+typedef struct timer_event
+{
+    uint32_t tick;
+    uint32_t periods;
+    uint16_t timer_id;
+}
+timer_event_t;
+
+CIRCULAR_BUFFER_TYPED_DEFINE(timer_event_buffer_t, Timer_Event_Buffer, timer_event_t)
+
+static volatile timer_t timers[TMR_AMOUNT] = {{NULL, TYPE_NOT_DEFINED, 0, 0, TIMER_EMPTY, TMR_NOT_QUEUED, TIMER_CATCHUP_FIRE_ALL, 0, 0, 0, 0}};
+
+/*
+ * Running timers are kept in a binary min-heap ordered by timeout, so the next
+ * timer to expire is always timer_heap[0]. The tick interrupt only looks at the
+ * top of the heap, and inserting/removing a timer costs O(log n).
+ * timers[id].heap_pos is the position of the timer in the heap.
+ *
+ * Expired timers are handled in the tick interrupt (Timer_Expire): hard timers
+ * call their callback there, soft timers push an event to timer_events, which
+ * Timer_SM drains in the main loop. A soft timer has at most one event in the
+ * queue (event_pending), further expirations are added to missed, so the queue
+ * never overflows. Timer_Stop/Start/Delete cancel the queued event
+ * (event_cancelled) and clear missed: Timer_SM drops it, and only calls back
+ * for the expirations counted after the cancel. A cancel from a callback called
+ * by Timer_SM (timer_sm_id) also ends its catch-up calls (timer_sm_cancelled).
+ * The functions called from the main loop change the heap with interrupts masked.
+ */
+static uint16_t timer_heap[TMR_AMOUNT];
+static uint16_t timer_heap_size = 0;
+CIRCULAR_BUFFER_TYPED_STORAGE(timer_event_storage, timer_event_t, TMR_EVENT_AMOUNT);
+static volatile timer_event_buffer_t timer_events;
+static volatile uint16_t timer_sm_id = UINT16_MAX;  // timer whose callback Timer_SM is calling
+static volatile uint8_t timer_sm_cancelled = 0;
+
+CIRCULAR_BUFFER_STATIC_ASSERT(TMR_EVENT_AMOUNT > TMR_AMOUNT, "TMR_EVENT_AMOUNT must be greater than TMR_AMOUNT");
+#if defined(TIMER_TICKLESS)
+static volatile uint8_t compare_is_armed = 0;
+static uint32_t compare_timeout = 0;
+#else
 static volatile uint32_t systemtick = 0;
-static volatile uint32_t delay_time = 0;
+#endif
+static volatile uint32_t systemtick_epoch = 0;   // half wraps (bit 31 toggles) of the 32 bits tick
 static uint8_t timer_is_initialized = 0;
 
+/**
+ * @brief Wrap-safe difference between two ticks: negative if a is before b.
+ * Valid while they are less than 2^31 ticks apart (see TIMER_MAX_PERIOD).
+ */
+static inline int32_t Timer_Tick_Diff(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b);
+}
+
+static inline uint32_t Timer_Lock(void)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    return primask;
+}
+
+static inline void Timer_Unlock(uint32_t primask)
+{
+    __set_PRIMASK(primask);
+}
+
 /**
  * @brief Configure System Clock: HSI and PLL. 64MHz as main system Clock.
  *
@@ -74,16 +150,406 @@ static void Sys_Clock_Init(void)
 }
 
 
+static void Timer_Heap_Place(uint16_t pos, uint16_t timer_id)
+{
+    timer_heap[pos] = timer_id;
+    timers[timer_id].heap_pos = pos;
+}
+
+static void Timer_Heap_Sift_Up(uint16_t pos)
+{
+    uint16_t timer_id = timer_heap[pos];
+
+    while (pos > 0)
+    {
+        uint16_t parent = (pos - 1) / 2;
+
+        if (Timer_Tick_Diff(timers[timer_heap[parent]].timeout, timers[timer_id].timeout) <= 0)
+        {
+            break;
+        }
+
+        Timer_Heap_Place(pos, timer_heap[parent]);
+        pos = parent;
+    }
+
+    Timer_Heap_Place(pos, timer_id);
+}
+
+static void Timer_Heap_Sift_Down(uint16_t pos)
+{
+    uint16_t timer_id = timer_heap[pos];
+
+    while (1)
+    {
+        uint16_t child = 2 * pos + 1;
+
+        if (child >= timer_heap_size)
+        {
+            break;
+        }
+
+        if (((child + 1) < timer_heap_size) && \
+            (Timer_Tick_Diff(timers[timer_heap[child + 1]].timeout, timers[timer_heap[child]].timeout) < 0))
+        {
+            child++;
+        }
+
+        if (Timer_Tick_Diff(timers[timer_id].timeout, timers[timer_heap[child]].timeout) <= 0)
+        {
+            break;
+        }
+
+        Timer_Heap_Place(pos, timer_heap[child]);
+        pos = child;
+    }
+
+    Timer_Heap_Place(pos, timer_id);
+}
+
+/**
+ * @brief Puts a timer in the heap, or moves it to the right position if its
+ * timeout changed.
+ */
+static void Timer_Heap_Update(uint16_t timer_id)
+{
+    uint16_t pos = timers[timer_id].heap_pos;
+
+    if (TMR_NOT_QUEUED == pos)
+    {
+        pos = timer_heap_size++;
+        Timer_Heap_Place(pos, timer_id);
+    }
+    else
+    {
+        /* do nothing */
+    }
+
+    Timer_Heap_Sift_Up(pos);
+    Timer_Heap_Sift_Down(timers[timer_id].heap_pos);
+}
+
+static void Timer_Heap_Remove(uint16_t timer_id)
+{
+    uint16_t pos = timers[timer_id].heap_pos;
+
+    if (TMR_NOT_QUEUED == pos)
+    {
+        return;
+    }
+
+    timers[timer_id].heap_pos = TMR_NOT_QUEUED;
+
+    if (pos != --timer_heap_size)
+    {
+        // The last timer takes the free position
+        Timer_Heap_Place(pos, timer_heap[timer_heap_size]);
+        Timer_Heap_Sift_Up(pos);
+        Timer_Heap_Sift_Down(timers[timer_heap[pos]].heap_pos);
+    }
+    else
+    {
+        /* do nothing */
+    }
+}
+
+
+/**
+ * @brief Cancels the expirations of a timer not handled by Timer_SM yet (its
+ * queued event and the missed ones). Called with the interrupts masked.
+ */
+static void Timer_Cancel_Events(uint16_t timer_id)
+{
+    timers[timer_id].missed = 0;
+
+    // The event stays queued (event_pending), so the timer never has two
+    if (timers[timer_id].event_pending)
+    {
+        timers[timer_id].event_cancelled = 1;
+    }
+    else
+    {
+        /* do nothing */
+    }
+
+    // Called back from Timer_SM: the expirations left in its loop are stale too
+    if (timer_id == timer_sm_id)
+    {
+        timer_sm_cancelled = 1;
+    }
+    else
+    {
+        /* do nothing */
+    }
+}
+
+/**
+ * @brief Handles the expired timers, from the tick interrupt.
+ */
+static void Timer_Expire(uint32_t tick)
+{
+    uint16_t fire_limit = timer_heap_size;
+
+    /* An auto-reload timer that is late by several periods (TIMER_CATCHUP_FIRE_ALL)
+     * fires once per timer in the heap, at most, per interrupt. */
+    while ((0 < timer_heap_size) && (0 < fire_limit) && \
+           (Timer_Tick_Diff(tick, timers[timer_heap[0]].timeout) >= 0))
+    {
+        uint16_t timer_id = timer_heap[0];
+        timer_callback_t cbk = timers[timer_id].cbk;
+        timer_event_t event = {tick, 1, timer_id};
+
+        fire_limit--;
+
+        /* Reschedule before the callback, so it can start/stop/delete this timer */
+        switch (timers[timer_id].type)
+        {
+            case ONE_SHOT_TIMER:
+                timers[timer_id].state = TIMER_STOPPED;
+                Timer_Heap_Remove(timer_id);
+            break;
+
+            case AUTO_RELOAD_TIMER:
+                if (TIMER_CATCHUP_FIRE_ALL != timers[timer_id].catchup)
+                {
+                    // Skip the missed periods: next timeout is the first one after tick
+                    event.periods += (tick - timers[timer_id].timeout) / timers[timer_id].period;
+                }
+                else
+                {
+                    /* do nothing */
+                }
+
+                timers[timer_id].timeout += event.periods * timers[timer_id].period;
+                Timer_Heap_Sift_Down(0);
+            break;
+
+            default:
+                timers[timer_id].state = TIMER_ERROR;
+                Timer_Heap_Remove(timer_id);
+            break;
+        }
+
+        if (TIMER_CATCHUP_REPORT != timers[timer_id].catchup)
+        {
+            event.periods = 1;
+        }
+        else
+        {
+            /* do nothing */
+        }
+
+        if (NULL == cbk)
+        {
+            timers[timer_id].state = TIMER_ERROR;
+            Timer_Heap_Remove(timer_id);
+        }
+        else if (timers[timer_id].hard)
+        {
+            cbk((void*)&tick, event.periods);
+        }
+        else if (timers[timer_id].event_pending)
+        {
+            // The last expiration was not handled by Timer_SM yet
+            timers[timer_id].missed += event.periods;
+        }
+        else
+        {
+            timers[timer_id].event_pending = 1;
+            Timer_Event_Buffer_Write(&timer_events, event);
+        }
+    }
+}
+
+
+#if defined(TIMER_TICKLESS)
+/*
+ * Tickless timebase: TIM2 counts at TIMEBASE (low 16 bits of the system tick)
+ * and TIM3 counts the TIM2 overflows (high 16 bits). The counters run without
+ * any interrupt. A CC1 interrupt is armed only for the timeout of the next timer:
+ *  - TIM3 CC1 if the timeout is in another 65536 ticks block,
+ *  - TIM2 CC1 once the timeout is in the current block.
+ * TIM3 update and CC2 (at 0x8000) count the half wraps of the tick, for Timer_GetSystemTick64.
+ */
+static void Timebase_Init(void)
+{
+    RCC->APB1ENR |= RCC_APB1ENR_TIM2EN | RCC_APB1ENR_TIM3EN;
+
+    // TIM3: slave, external clock mode 1 with TIM2 TRGO (ITR1) as clock
+    TIM3->SMCR = TIM_SMCR_TS_0 | TIM_SMCR_SMS;
+    TIM3->ARR = 0xFFFF;
+    TIM3->CCR2 = 0x8000;
+    TIM3->CR1 = TIM_CR1_CEN;
+
+    // TIM2: master, TRGO on each overflow. APB1 = HCLK/2, so TIM2CLK = 2*PCLK1 = SystemCoreClock
+    TIM2->PSC = (SystemCoreClock / TIMEBASE) - 1;
+    TIM2->ARR = 0xFFFF;
+    TIM2->EGR = TIM_EGR_UG;                     // load PSC (also clocks TIM3 once)
+    TIM2->CR2 = TIM_CR2_MMS_1;
+    TIM2->SR = 0;
+    TIM3->SR = 0;
+    TIM3->CNT = 0;
+    TIM3->DIER = TIM_DIER_UIE | TIM_DIER_CC2IE;
+    TIM2->CR1 = TIM_CR1_CEN;
+
+    NVIC_SetPriority(TIM2_IRQn, 1);
+    NVIC_SetPriority(TIM3_IRQn, 1);
+    NVIC_EnableIRQ(TIM2_IRQn);
+    NVIC_EnableIRQ(TIM3_IRQn);
+}
+
+/**
+ * @brief Arms the compare interrupt for the timeout of the first timer of the heap
+ * (or disarms it if there is no running timer).
+ */
+static void Timebase_Arm(void)
+{
+    uint32_t timeout;
+    uint32_t tick;
+
+    if (0 == timer_heap_size)
+    {
+        TIM2->DIER &= ~TIM_DIER_CC1IE;
+        TIM3->DIER &= ~TIM_DIER_CC1IE;
+        compare_is_armed = 0;
+        return;
+    }
+
+    timeout = timers[timer_heap[0]].timeout;
+
+    if (compare_is_armed && (compare_timeout == timeout))
+    {
+        return;
+    }
+
+    TIM2->DIER &= ~TIM_DIER_CC1IE;
+    TIM3->DIER &= ~TIM_DIER_CC1IE;
+    compare_timeout = timeout;
+    compare_is_armed = 1;
+
+    tick = Timer_GetSystemTick();
+
+    if ((timeout >> 16) != (tick >> 16))
+    {
+        TIM3->CCR1 = (uint16_t)(timeout >> 16);
+        TIM3->SR = (uint16_t)~TIM_SR_CC1IF;
+        TIM3->DIER |= TIM_DIER_CC1IE;
+
+        // TIM3 may have reached the block before CCR1 was written: that match is
+        // lost (the next one is 2^32 ticks later), so use TIM2 as below
+        tick = Timer_GetSystemTick();
+    }
+    else
+    {
+        /* do nothing */
+    }
+
+    if ((timeout >> 16) == (tick >> 16))
+    {
+        TIM3->DIER &= ~TIM_DIER_CC1IE;
+        TIM2->CCR1 = (uint16_t)timeout;
+        TIM2->SR = (uint16_t)~TIM_SR_CC1IF;
+        TIM2->DIER |= TIM_DIER_CC1IE;
+    }
+    else
+    {
+        /* do nothing */
+    }
+
+    // Already expired while arming: the compare would only match after a wrap
+    if (Timer_Tick_Diff(Timer_GetSystemTick(), timeout) >= 0)
+    {
+        NVIC_SetPendingIRQ(TIM2_IRQn);
+    }
+    else
+    {
+        /* do nothing */
+    }
+}
+
+/**
+ * @brief Arms TIM2 CC2 to wake up a delay at the deadline. If the deadline is
+ * in another 65536 ticks block it matches earlier, and the delay sleeps again.
+ */
+static void Timebase_Arm_Delay(uint32_t deadline)
+{
+    TIM2->CCR2 = (uint16_t)deadline;
+    TIM2->SR = (uint16_t)~TIM_SR_CC2IF;
+    TIM2->DIER |= TIM_DIER_CC2IE;
+}
+
+void TIM2_IRQHandler(void)
+{
+    // Delay deadline (Timer_Delay_Until re-arms it if needed)
+    if (TIM2->SR & TIM_SR_CC2IF)
+    {
+        TIM2->DIER &= ~TIM_DIER_CC2IE;
+        TIM2->SR = (uint16_t)~TIM_SR_CC2IF;
+    }
+    else
+    {
+        /* do nothing */
+    }
+
+    // Timeout reached (or pended by Timebase_Arm)
+    TIM2->DIER &= ~TIM_DIER_CC1IE;
+    TIM2->SR = (uint16_t)~TIM_SR_CC1IF;
+    compare_is_armed = 0;
+
+    Timer_Expire(Timer_GetSystemTick());
+    Timebase_Arm();
+}
+
+void TIM3_IRQHandler(void)
+{
+    uint16_t status = TIM3->SR;
+
+    // Tick bit 31 toggled (TIM3 wrapped or reached 0x8000)
+    if (status & (TIM_SR_UIF | TIM_SR_CC2IF))
+    {
+        TIM3->SR = (uint16_t)~(status & (TIM_SR_UIF | TIM_SR_CC2IF));
+        systemtick_epoch++;
+    }
+    else
+    {
+        /* do nothing */
+    }
+
+    // Timeout block reached: arm TIM2 for the low 16 bits
+    if ((status & TIM_SR_CC1IF) && (TIM3->DIER & TIM_DIER_CC1IE))
+    {
+        TIM3->DIER &= ~TIM_DIER_CC1IE;
+        TIM3->SR = (uint16_t)~TIM_SR_CC1IF;
+        compare_is_armed = 0;
+        Timebase_Arm();
+    }
+    else
+    {
+        /* do nothing */
+    }
+}
+#else
 void SysTick_Handler(void)
 {
 	systemtick++;
-	delay_time++;
+
+	if (0 == (systemtick & 0x7FFFFFFFUL))
+	{
+	    systemtick_epoch++;
+	}
+
+	if ((0 < timer_heap_size) && (Timer_Tick_Diff(systemtick, timers[timer_heap[0]].timeout) >= 0))
+	{
+	    Timer_Expire(systemtick);
+	}
 }
+#endif
 
 
 /**
- * @brief Initialization of the timers. Config the SysTick interrupt and
- * reset all the timers flags. Execute the function Sys_Clock_Init before this.
+ * @brief Initialization of the timers. Config the SysTick interrupt (or TIM2/TIM3
+ * if TIMER_TICKLESS is defined) and reset all the timers flags. Execute the
+ * function Sys_Clock_Init before this.
  */
 void Timer_Init(void)
 {
@@ -91,9 +557,13 @@ void Timer_Init(void)
 
 	SystemCoreClockUpdate();
 
+#if defined(TIMER_TICKLESS)
+    Timebase_Init();
+#else
     /* https://www.keil.com/pack/doc/CMSIS_Dev/Core/html/group__system__init__gr.html */
     /* Config SysTick interrupt. Callback: SysTick_Handler */
 	SysTick_Config(SystemCoreClock / TIMEBASE);
+#endif
 
 	timer_is_initialized = 1;
 
@@ -101,9 +571,22 @@ void Timer_Init(void)
     {
         timers[i].state = TIMER_EMPTY;
         timers[i].type = TYPE_NOT_DEFINED;
+        timers[i].heap_pos = TMR_NOT_QUEUED;
+        timers[i].event_pending = 0;
+        timers[i].event_cancelled = 0;
     }
 
+    timer_heap_size = 0;
+    Timer_Event_Buffer_Init(&timer_events, timer_event_storage, TMR_EVENT_AMOUNT);
+
+#if !defined(TIMER_TICKLESS)
 	NVIC_SetPriority(SysTick_IRQn, 1);
+#endif
+
+    /* Cycle counter, for Timer_Delay_Cycles */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
 }// end Timer_Init
 
@@ -116,51 +599,115 @@ void Timer_Init(void)
  */
 uint32_t Timer_GetSystemTick(void)
 {
+#if defined(TIMER_TICKLESS)
+    uint16_t high = TIM3->CNT;
+    uint16_t low = TIM2->CNT;
+    uint16_t high_again = TIM3->CNT;
+
+    // TIM2 overflowed between the reads (TIM3 increments a few clocks after TIM2
+    // wraps, before the second read of TIM3 completes)
+    if (high != high_again)
+    {
+        high = high_again;
+        low = TIM2->CNT;
+    }
+    else
+    {
+        /* do nothing */
+    }
+
+    return ((uint32_t)high << 16) | low;
+#else
 	return systemtick;
+#endif
+}
+
+uint64_t Timer_GetSystemTick64(void)
+{
+    uint32_t epoch = systemtick_epoch;
+    uint32_t tick = Timer_GetSystemTick();
+
+    // The half wrap of the tick may not be counted yet (epoch read before it, or
+    // the interrupt that counts it is pending/preempted): bit 31 tells it
+    if ((tick >> 31) != (epoch & 1))
+    {
+        epoch++;
+    }
+    else
+    {
+        /* do nothing */
+    }
+
+    return ((uint64_t)(epoch >> 1) << 32) | tick;
 }
 
 void Timer_SM(void)
 {
-    static uint16_t timer_cnt = 0;
-    uint32_t tick = systemtick;
+    timer_event_t event;
 
     if (0 == timer_is_initialized)
     {
         return;
     }
 
-    if ((TIMER_RUNNING == timers[timer_cnt].state) && \
-        (systemtick >= timers[timer_cnt].timeout))
+    while (BUFFER_OK == Timer_Event_Buffer_Read(&timer_events, &event))
     {
-        if (NULL != timers[timer_cnt].cbk)
+        volatile timer_t * timer = &timers[event.timer_id];
+        uint32_t primask = Timer_Lock();
+        uint32_t missed = timer->missed;
+        uint8_t cancelled = timer->event_cancelled;
+
+        timer->missed = 0;
+        timer->event_pending = 0;
+        timer->event_cancelled = 0;
+        Timer_Unlock(primask);
+
+        if ((TIMER_EMPTY == timer->state) || (NULL == timer->cbk))
+        {
+            continue;
+        }
+        else if (cancelled)
         {
-            timers[timer_cnt].cbk((void*)&tick, 1);
+            // Queued before Timer_Stop/Start/Delete: only the expirations counted
+            // after it (in missed, since this event was still queued) are due
+            if (0 == missed)
+            {
+                continue;
+            }
+
+            missed--;
+            event.periods = 1;
+            event.tick = Timer_GetSystemTick();
         }
         else
         {
-            timers[timer_cnt].state = TIMER_ERROR;
+            /* do nothing */
         }
 
-        switch (timers[timer_cnt].type)
+        timer_sm_id = event.timer_id;
+        timer_sm_cancelled = 0;
+
+        switch (timer->catchup)
         {
-            case ONE_SHOT_TIMER:
-                timers[timer_cnt].state = TIMER_STOPPED;
+            case TIMER_CATCHUP_REPORT:
+                timer->cbk((void*)&event.tick, event.periods + missed);
             break;
 
-            case AUTO_RELOAD_TIMER:
-                timers[timer_cnt].timeout += timers[timer_cnt].period;
+            case TIMER_CATCHUP_REALIGN:
+                timer->cbk((void*)&event.tick, 1);
             break;
 
             default:
-                timers[timer_cnt].state = TIMER_ERROR;
+                // Once for this expiration and once for each one missed meanwhile,
+                // until a callback stops, restarts or deletes the timer
+                for (uint32_t i = 0; (i <= missed) && (0 == timer_sm_cancelled); i++)
+                {
+                    timer->cbk((void*)&event.tick, 1);
+                }
             break;
         }
 
-    }
-
-    if (TMR_AMOUNT <= (++timer_cnt))
-    {
-        timer_cnt = 0;
+        timer_sm_id = UINT16_MAX;
     }
 
 }
@@ -172,23 +719,35 @@ uint16_t Timer_Create(timer_callback_t timer_cbk, timer_type_t timer_type, \
 
     for (uint16_t i = 0; i < TMR_AMOUNT; i++)
     {
-        if (TIMER_EMPTY == timers[i].state)
+        // A deleted timer keeps its slot until its last event is handled
+        if ((TIMER_EMPTY == timers[i].state) && (0 == timers[i].event_pending))
         {
             if (NULL == timer_cbk)
             {
                 /* do nothing */
             }
-            else if ((AUTO_RELOAD_TIMER < timer_type) || (0 == timer_period))
+            else if ((AUTO_RELOAD_TIMER < timer_type) || (0 == timer_period) || \
+                     (TIMER_MAX_PERIOD < timer_period))
             {
                 /* do nothing */
             }
             else
             {
+                uint32_t primask = Timer_Lock();
+
                 timers[i].cbk = timer_cbk;
                 timers[i].type = timer_type;
                 timers[i].period = timer_period;
-                timers[i].timeout = (uint32_t)(systemtick + timer_period);
+                timers[i].catchup = TIMER_CATCHUP_FIRE_ALL;
+                timers[i].hard = 0;
+                timers[i].missed = 0;
+                timers[i].timeout = (uint32_t)(Timer_GetSystemTick() + timer_period);
                 timers[i].state = TIMER_RUNNING;
+                Timer_Heap_Update(i);
+#if defined(TIMER_TICKLESS)
+                Timebase_Arm();
+#endif
+                Timer_Unlock(primask);
 
                 result = i;
             }
@@ -214,6 +773,8 @@ void Timer_Config(uint16_t timer_id, timer_callback_t timer_cbk, \
     }
     else if (TIMER_EMPTY != timers[timer_id].state)
     {
+        uint32_t primask = Timer_Lock();
+
         if (NULL != timer_cbk)
         {
             timers[timer_id].cbk = timer_cbk;
@@ -233,7 +794,7 @@ void Timer_Config(uint16_t timer_id, timer_callback_t timer_cbk, \
             /* do nothing */
         }
 
-        if (0 != timer_period)
+        if ((0 != timer_period) && (TIMER_MAX_PERIOD >= timer_period))
         {
             timers[timer_id].period = timer_period;
         }
@@ -241,6 +802,40 @@ void Timer_Config(uint16_t timer_id, timer_callback_t timer_cbk, \
         {
             /* do nothing */
         }
+
+        Timer_Unlock(primask);
+    }
+    else
+    {
+        /* do nothing */
+    }
+}
+
+void Timer_Set_Catchup(uint16_t timer_id, timer_catchup_t catchup)
+{
+    if (TMR_AMOUNT <= timer_id)
+    {
+        /* do nothing */
+    }
+    else if ((TIMER_EMPTY != timers[timer_id].state) && (TIMER_CATCHUP_REPORT >= catchup))
+    {
+        timers[timer_id].catchup = catchup;
+    }
+    else
+    {
+        /* do nothing */
+    }
+}
+
+void Timer_Set_Hard(uint16_t timer_id, uint8_t hard)
+{
+    if (TMR_AMOUNT <= timer_id)
+    {
+        /* do nothing */
+    }
+    else if (TIMER_EMPTY != timers[timer_id].state)
+    {
+        timers[timer_id].hard = (0 != hard);
     }
     else
     {
@@ -256,7 +851,12 @@ void Timer_Delete(uint16_t timer_id)
     }
     else
     {
+        uint32_t primask = Timer_Lock();
+
         timers[timer_id].state = TIMER_EMPTY;
+        Timer_Heap_Remove(timer_id);
+        Timer_Cancel_Events(timer_id);
+        Timer_Unlock(primask);
     }
 
 }
@@ -269,8 +869,16 @@ void Timer_Start(uint16_t timer_id)
     }
     else if (TIMER_EMPTY != timers[timer_id].state)
     {
-        timers[timer_id].timeout = (uint32_t)(systemtick + timers[timer_id].period);
+        uint32_t primask = Timer_Lock();
+
+        timers[timer_id].timeout = (uint32_t)(Timer_GetSystemTick() + timers[timer_id].period);
         timers[timer_id].state = TIMER_RUNNING;
+        Timer_Cancel_Events(timer_id);
+        Timer_Heap_Update(timer_id);
+#if defined(TIMER_TICKLESS)
+        Timebase_Arm();
+#endif
+        Timer_Unlock(primask);
     }
     else
     {
@@ -291,7 +899,12 @@ void Timer_Stop(uint16_t timer_id)
     }
     else if (TIMER_EMPTY != timers[timer_id].state)
     {
+        uint32_t primask = Timer_Lock();
+
         timers[timer_id].state = TIMER_STOPPED;
+        Timer_Heap_Remove(timer_id);
+        Timer_Cancel_Events(timer_id);
+        Timer_Unlock(primask);
     }
     else
     {
@@ -320,6 +933,68 @@ timer_state_t Timer_GetTimerState(uint16_t timer_id)
     return state;
 }
 
+/**
+ * @brief Busy-waits the ticks left until the deadline, counted in CPU cycles
+ * (DWT CYCCNT), for contexts where the tick may not advance.
+ */
+static void Timer_Delay_Until_Busy(uint32_t deadline)
+{
+    uint32_t cycles_per_tick = SystemCoreClock / TIMEBASE;
+    uint32_t max_ticks = UINT32_MAX / cycles_per_tick;
+    int32_t remaining = Timer_Tick_Diff(deadline, Timer_GetSystemTick());
+
+    while (remaining > 0)
+    {
+        // Timer_Delay_Cycles counts up to 2^32 - 1 cycles per call
+        uint32_t ticks = ((uint32_t)remaining > max_ticks) ? max_ticks : (uint32_t)remaining;
+
+        Timer_Delay_Cycles(ticks * cycles_per_tick);
+        remaining -= (int32_t)ticks;
+    }
+}
+
+/**
+ * @brief Waits until the deadline tick, sleeping (WFI) between ticks. Reentrant:
+ * each call only uses its own deadline.
+ *
+ * In an interrupt handler, or with the interrupts masked, it busy-waits on the
+ * cycle counter instead: the tick interrupt may not preempt the caller (the
+ * SysTick_Handler itself, for a hard timer callback), so the tick would not
+ * advance.
+ */
+static void Timer_Delay_Until(uint32_t deadline)
+{
+    if ((0 != __get_IPSR()) || (0 != __get_PRIMASK()))
+    {
+        Timer_Delay_Until_Busy(deadline);
+        return;
+    }
+
+    while (Timer_Tick_Diff(Timer_GetSystemTick(), deadline) < 0)
+    {
+#if defined(TIMER_TICKLESS)
+        // No periodic tick: arm TIM2 CC2 to wake up. A pending interrupt wakes WFI even with PRIMASK set
+        uint32_t primask = Timer_Lock();
+
+        Timebase_Arm_Delay(deadline);
+
+        if (Timer_Tick_Diff(Timer_GetSystemTick(), deadline) < 0)
+        {
+            __WFI();
+        }
+        else
+        {
+            /* do nothing */
+        }
+
+        Timer_Unlock(primask);
+#else
+        // Woken up by the SysTick interrupt
+        __WFI();
+#endif
+    }
+}
+
 /**
  * @brief Delay in milisseconds
  *
@@ -327,32 +1002,30 @@ timer_state_t Timer_GetTimerState(uint16_t timer_id)
  */
 void Timer_Delay(uint32_t time_ms)
 {
-    delay_time = 0;
-    while (delay_time < time_ms*TIME_1MS)
-    {
-        asm volatile("nop");
-    }
+    Timer_Delay_Until(Timer_GetSystemTick() + time_ms*TIME_1MS);
 }
 
 void Timer_Delay_10us(uint32_t time_10us)
 {
-    delay_time = 0;
-    while (delay_time < time_10us*2)
-    {
-        asm volatile("nop");
-    }
+    Timer_Delay_Until(Timer_GetSystemTick() + time_10us*2);
 }
 
 void Timer_Delay_5us(uint32_t time_5us)
 {
+    Timer_Delay_Until(Timer_GetSystemTick() + time_5us);
+}
+
+void Timer_Delay_1us(uint32_t time_1us)
+{
+    Timer_Delay_Cycles(time_1us * (SystemCoreClock / 1000000UL));
+}
 
-	delay_time = 0;
+void Timer_Delay_Cycles(uint32_t cycles)
+{
+    uint32_t start = DWT->CYCCNT;
 
-    while (delay_time < time_5us)
+    while ((DWT->CYCCNT - start) < cycles)
     {
-        asm volatile("nop");
+        /* do nothing */
     }
-
 }
-
-
@@ -14,11 +14,25 @@ extern "C" {
 
 #define TIMEBASE 	(200000UL) 					// usdo para configurar o systick. 200000: interrupt a cada 5 us.
 
+/*
+ * Define TIMER_TICKLESS (e.g. -DTIMER_TICKLESS) to count the system tick with
+ * TIM2 + TIM3 instead of the SysTick interrupt. The tick keeps the TIMEBASE
+ * resolution, but there is only an interrupt when a timer expires, so the CPU can
+ * sleep (WFI) between timeouts. TIM2 and TIM3 are used by this module.
+ */
+
 #define TIME_1MS 	(TIMEBASE/1000UL)
 #define TIME_1S		(TIME_1MS*1000UL)
 #define TIME_1MIN	(TIME_1S*60UL)
 #define TIME_1H		(TIME_1MIN*60UL)
 
+/**
+ * @brief Longest timer period (ticks): timeouts are compared by the signed
+ * difference to the system tick, so they must be less than 2^31 ticks ahead
+ * (about 2.9 hours with TIMEBASE 200 kHz).
+ */
+#define TIMER_MAX_PERIOD    (0x7FFFFFFFUL)
+
 /**
  * @brief Types of timer.
  *
@@ -45,13 +59,27 @@ typedef enum
 }
 timer_state_t;
 
+/**
+ * @brief What an auto-reload timer does when Timer_SM runs late by more than one period.
+ *
+ */
+typedef enum
+{
+    TIMER_CATCHUP_FIRE_ALL = 0,     /**< Fires once for each missed period (default) */
+    TIMER_CATCHUP_REALIGN,          /**< Fires once, the missed periods are skipped */
+    TIMER_CATCHUP_REPORT,           /**< Fires once, size is the quantity of periods elapsed */
+}
+timer_catchup_t;
+
 /**
  * @brief Timer callback definition.
  *
  * The callback functions must accept a void pointer and a uint32_t varible as
  * parameters.
  *
- * The timer library will pass the current systick value on ptr parameter.
+ * The timer library will pass the systick value of the expiration on ptr parameter.
+ * size is 1, except for TIMER_CATCHUP_REPORT timers: the quantity of periods
+ * elapsed since the last call (1 if on time, 1 + missed periods if late).
  *
  */
 typedef void (*timer_callback_t)(void* ptr, uint32_t size);
@@ -65,7 +93,12 @@ typedef void (*timer_callback_t)(void* ptr, uint32_t size);
 void Timer_Init(void);
 
 /**
- * @brief Timer State Machine
+ * @brief Timer State Machine. Calls the callbacks of the soft timers that
+ * expired since the last call.
+ *
+ * Call it from the main loop. Expirations are detected in the tick interrupt
+ * and queued, so the callbacks get the tick of the expiration even if the main
+ * loop is late. The cost does not depend on TMR_AMOUNT.
  *
  */
 void Timer_SM(void);
@@ -77,6 +110,16 @@ void Timer_SM(void);
  */
 uint32_t Timer_GetSystemTick(void);
 
+/**
+ * @brief Get current System tick value, in 64 bits (does not wrap).
+ *
+ * Lock-free: can be called from any context, including interrupts of any
+ * priority, without disabling interrupts.
+ *
+ * @return uint64_t System tick since Timer_Init.
+ */
+uint64_t Timer_GetSystemTick64(void);
+
 /**
  * @brief Creates a timer.
  *
@@ -84,7 +127,7 @@ uint32_t Timer_GetSystemTick(void);
  *
  * @param timer_cbk Timer callback.
  * @param timer_type Timer type.
- * @param timer_period Timer period.
+ * @param timer_period Timer period (1 to TIMER_MAX_PERIOD ticks).
  * @return uint16_t Returns timer ID or 0xFFFF if cannot creates it.
  */
 uint16_t Timer_Create(timer_callback_t timer_cbk, timer_type_t timer_type, \
@@ -96,29 +139,60 @@ uint16_t Timer_Create(timer_callback_t timer_cbk, timer_type_t timer_type, \
  * @param timer_id Timer ID to be configured.
  * @param timer_cbk New timer callback, if NULL the callback stills the old one.
  * @param timer_type New timer type, if KEEP_TIMER_TYPE the type stills the same.
- * @param timer_period New timer peridod, if zero the period stills the same.
+ * @param timer_period New timer peridod, if zero (or above TIMER_MAX_PERIOD) the period stills the same.
  * This also changes timer timeout.
  */
 void Timer_Config(uint16_t timer_id, timer_callback_t timer_cbk, \
     timer_type_t timer_type, uint32_t timer_period);
 
+/**
+ * @brief Selects what an auto-reload timer does when it expires late by more
+ * than one period, e.g. after the main loop was blocked. Timers are created
+ * with TIMER_CATCHUP_FIRE_ALL.
+ *
+ * With TIMER_CATCHUP_REALIGN or TIMER_CATCHUP_REPORT, the next timeout stays
+ * in phase with the period (timeout + N * period).
+ *
+ * @param timer_id Timer ID to be configured.
+ * @param catchup Catch-up policy.
+ */
+void Timer_Set_Catchup(uint16_t timer_id, timer_catchup_t catchup);
+
+/**
+ * @brief Selects where the timer callback runs. Timers are created soft.
+ *
+ * Soft: from Timer_SM, in the main loop.
+ * Hard: from the timer interrupt (SysTick, or TIM2 with TIMER_TICKLESS), right
+ * when the timer expires, with TIMEBASE resolution. The callback must be short
+ * and interrupt-safe (it runs at NVIC priority 1).
+ *
+ * @param timer_id Timer ID to be configured.
+ * @param hard 1 for a hard timer, 0 for a soft timer.
+ */
+void Timer_Set_Hard(uint16_t timer_id, uint8_t hard);
+
 
 /**
- * @brief Deletes an existing timer.
+ * @brief Deletes an existing timer. Expirations not handled by Timer_SM yet
+ * are dropped.
  *
  * @param timer_id Timer ID to be deleted.
  */
 void Timer_Delete(uint16_t timer_id);
 
 /**
- * @brief Start a stopped timer.
+ * @brief Start a stopped timer (or restart a running one). Expirations not
+ * handled by Timer_SM yet are dropped.
  *
  * @param timer_id Timer ID.
  */
 void Timer_Start(uint16_t timer_id);
 
 /**
- * @brief Stops a running timer.
+ * @brief Stops a running timer. Expirations not handled by Timer_SM yet are
+ * dropped, also when called from the timer callback (the remaining catch-up
+ * calls of TIMER_CATCHUP_FIRE_ALL are not made). The same applies to
+ * Timer_Start and Timer_Delete.
  *
  * @param timer_id Timer ID.
  */
@@ -132,6 +206,14 @@ void Timer_Stop(uint16_t timer_id);
  */
 timer_state_t Timer_GetTimerState(uint16_t timer_id);
 
+/*
+ * The delays below sleep (WFI) until the deadline, and can be nested. In an
+ * interrupt handler (including hard timer callbacks) or with the interrupts
+ * masked, they busy-wait on the DWT cycle counter instead, since the tick
+ * interrupt cannot run there. Resolution is one tick (5 us); use
+ * Timer_Delay_1us or Timer_Delay_Cycles for shorter delays.
+ */
+
 /**
  * @brief Delay in milisseconds
  *
@@ -153,6 +235,20 @@ void Timer_Delay_10us(uint32_t time_10us);
  */
 void Timer_Delay_5us(uint32_t time_5us);
 
+/**
+ * @brief Busy delay in multiples of 1us, counted in CPU cycles (DWT CYCCNT).
+ *
+ * @param time_1us time to delay. Ex: time_1us = 3: delay for 3us.
+ */
+void Timer_Delay_1us(uint32_t time_1us);
+
+/**
+ * @brief Busy delay in CPU cycles (DWT CYCCNT), e.g. 64 cycles = 1us at 64 MHz.
+ *
+ * @param cycles CPU cycles to delay.
+ */
+void Timer_Delay_Cycles(uint32_t cycles);
+
 
 #ifdef  __cplusplus
 }
@@ -1,5 +1,7 @@
 #include "uart.h"
 
+#include <stddef.h>
+
 /*
  * Transmission Procedure:
  * 1. Enable the USART by writing the UR bit in USART_CR1 register to 1.
@@ -36,16 +38,179 @@
 /* ####################################################### */
 
 
-/* PRIVATE FUNCTIONS PROTOTYPES */
+/* PRIVATE TYPES AND VARIABLES */
+
+CIRCULAR_BUFFER_STATIC_ASSERT(CIRCULAR_BUFFER_SIZE_IS_VALID(UART_DMA_TX_QUEUE),
+    "UART_DMA_TX_QUEUE must be a power of two");
+
+// DMA transfer waiting to be sent (or being sent, at i_first)
+typedef struct
+{
+    const uint8_t *data;
+    uint16_t length;
+    uint16_t notify;                        // length given to the TX callback when sent (0: no callback)
+    volatile message_buffer_t *msg_buffer;  // message to remove when sent (NULL: caller buffer)
+} uart_dma_tx_t;
+
+// Run time state of a port
+typedef struct
+{
+    Uart_RX_CallbackFunc_t rx_callback;
+    Uart_Error_CallbackFunc_t error_callback;
+    uart_errors_t errors;
+
+    // DMA TX
+    uart_dma_tx_t tx_queue[UART_DMA_TX_QUEUE];
+    uint8_t tx_first;
+    uint8_t tx_last;
+    uint8_t tx_busy;
+    uint8_t tx_msg_pending;
+    Uart_TX_CallbackFunc_t tx_callback;
+
+    // DMA RX
+    uint8_t *rx_storage;
+    uint16_t rx_size;
+    uint16_t rx_read;                       // position of the first byte not given to the callback
+    Uart_RX_Chunk_CallbackFunc_t rx_chunk_callback;
+} uart_state_t;
+
+// Fixed description of a port (registers, clocks, pins, IRQ, DMA channels)
+typedef struct
+{
+    USART_TypeDef *uart;
+    IRQn_Type irq;
+    volatile uint32_t *rcc_enr;             // RCC->APB1ENR or RCC->APB2ENR
+    uint32_t rcc_en;                        // USART clock enable bit in rcc_enr
+    uint8_t ppre_pos;                       // position of the APB prescaler in RCC->CFGR (PCLK1 or PCLK2)
+    GPIO_TypeDef *tx_port[2];               // TX port for UART_NO_REMAP, UART_REMAP (NULL: unsupported)
+    uint8_t tx_pin[2];
+    uint32_t tx_port_en[2];                 // GPIO clock enable bit in RCC->APB2ENR
+    uint32_t remap;                         // AFIO->MAPR remap bits
+
+    DMA_TypeDef *dma;                       // NULL: no DMA for this port
+    uint32_t dma_en;                        // DMA clock enable bit in RCC->AHBENR
+    DMA_Channel_TypeDef *dma_tx;
+    DMA_Channel_TypeDef *dma_rx;
+    IRQn_Type dma_tx_irq;
+    IRQn_Type dma_rx_irq;
+    uint8_t dma_tx_shift;                   // position of the channel flags in dma->ISR/IFCR
+    uint8_t dma_rx_shift;
+
+    volatile uart_state_t *state;
+} uart_port_t;
+
+enum
+{
+    UART_PORT_1,
+    UART_PORT_2,
+    UART_PORT_3,
+#if defined(UART4)
+    UART_PORT_4,
+    UART_PORT_5,
+#endif
+    UART_PORTS
+};
+
+static volatile uart_state_t uart_state[UART_PORTS];
+
+static const uart_port_t uart_ports[UART_PORTS] =
+{
+    [UART_PORT_1] =
+    {
+        .uart = USART1, .irq = USART1_IRQn,
+        .rcc_enr = &RCC->APB2ENR, .rcc_en = RCC_APB2ENR_USART1EN, .ppre_pos = RCC_CFGR_PPRE2_Pos,
+        .tx_port = {GPIOA, GPIOB}, .tx_pin = {9, 6}, .tx_port_en = {RCC_APB2ENR_IOPAEN, RCC_APB2ENR_IOPBEN},
+        .remap = AFIO_MAPR_USART1_REMAP,
+        .dma = DMA1, .dma_en = RCC_AHBENR_DMA1EN,
+        .dma_tx = DMA1_Channel4, .dma_tx_irq = DMA1_Channel4_IRQn, .dma_tx_shift = 12,
+        .dma_rx = DMA1_Channel5, .dma_rx_irq = DMA1_Channel5_IRQn, .dma_rx_shift = 16,
+        .state = &uart_state[UART_PORT_1],
+    },
+    [UART_PORT_2] =
+    {
+        .uart = USART2, .irq = USART2_IRQn,
+        .rcc_enr = &RCC->APB1ENR, .rcc_en = RCC_APB1ENR_USART2EN, .ppre_pos = RCC_CFGR_PPRE1_Pos,
+        .tx_port = {GPIOA, NULL}, .tx_pin = {2, 0}, .tx_port_en = {RCC_APB2ENR_IOPAEN, 0},
+        .remap = AFIO_MAPR_USART2_REMAP,
+        .dma = DMA1, .dma_en = RCC_AHBENR_DMA1EN,
+        .dma_tx = DMA1_Channel7, .dma_tx_irq = DMA1_Channel7_IRQn, .dma_tx_shift = 24,
+        .dma_rx = DMA1_Channel6, .dma_rx_irq = DMA1_Channel6_IRQn, .dma_rx_shift = 20,
+        .state = &uart_state[UART_PORT_2],
+    },
+    [UART_PORT_3] =
+    {
+        .uart = USART3, .irq = USART3_IRQn,
+        .rcc_enr = &RCC->APB1ENR, .rcc_en = RCC_APB1ENR_USART3EN, .ppre_pos = RCC_CFGR_PPRE1_Pos,
+        .tx_port = {GPIOB, NULL}, .tx_pin = {10, 0}, .tx_port_en = {RCC_APB2ENR_IOPBEN, 0},
+        .remap = AFIO_MAPR_USART3_REMAP,
+        .dma = DMA1, .dma_en = RCC_AHBENR_DMA1EN,
+        .dma_tx = DMA1_Channel2, .dma_tx_irq = DMA1_Channel2_IRQn, .dma_tx_shift = 4,
+        .dma_rx = DMA1_Channel3, .dma_rx_irq = DMA1_Channel3_IRQn, .dma_rx_shift = 8,
+        .state = &uart_state[UART_PORT_3],
+    },
+#if defined(UART4)
+    [UART_PORT_4] =
+    {
+        .uart = UART4, .irq = UART4_IRQn,
+        .rcc_enr = &RCC->APB1ENR, .rcc_en = RCC_APB1ENR_UART4EN, .ppre_pos = RCC_CFGR_PPRE1_Pos,
+        .tx_port = {GPIOC, NULL}, .tx_pin = {10, 0}, .tx_port_en = {RCC_APB2ENR_IOPCEN, 0},
+        .remap = 0,
+        .dma = DMA2, .dma_en = RCC_AHBENR_DMA2EN,
+        .dma_tx = DMA2_Channel5, .dma_tx_irq = DMA2_Channel4_5_IRQn, .dma_tx_shift = 16,
+        .dma_rx = DMA2_Channel3, .dma_rx_irq = DMA2_Channel3_IRQn, .dma_rx_shift = 8,
+        .state = &uart_state[UART_PORT_4],
+    },
+    [UART_PORT_5] =
+    {
+        .uart = UART5, .irq = UART5_IRQn,
+        .rcc_enr = &RCC->APB1ENR, .rcc_en = RCC_APB1ENR_UART5EN, .ppre_pos = RCC_CFGR_PPRE1_Pos,
+        .tx_port = {GPIOC, NULL}, .tx_pin = {12, 0}, .tx_port_en = {RCC_APB2ENR_IOPCEN, 0},
+        .remap = 0,
+        .dma = NULL,
+        .state = &uart_state[UART_PORT_5],
+    },
+#endif
+};
 
-static void Uart1_config(uint32_t baud, uart_remap_e remap);
-static void Uart2_config(uint32_t baud);
-static void Uart3_config(uint32_t baud);
+/*
+ * The USART registers are 1KB apart, so bits 12:10 of the address give a
+ * different value for each port (USART1: 6, USART2: 1, USART3: 2, UART4: 3,
+ * UART5: 4). UART_PORTS is used for the unused values.
+ */
+#define UART_PORT_KEY(UARTx)    ((((uint32_t)(UARTx)) >> 10) & 0x7)
+
+static const uint8_t uart_port_index[8] =
+{
+    UART_PORTS,
+    UART_PORT_2,
+    UART_PORT_3,
+#if defined(UART4)
+    UART_PORT_4,
+    UART_PORT_5,
+#else
+    UART_PORTS,
+    UART_PORTS,
+#endif
+    UART_PORTS,
+    UART_PORT_1,
+    UART_PORTS,
+};
 
-// Function pointer for RX interrupt Callbacks
-Uart_RX_CallbackFunc_t uart1_rx_callback;
-Uart_RX_CallbackFunc_t uart2_rx_callback;
-Uart_RX_CallbackFunc_t uart3_rx_callback;
+
+/* PRIVATE FUNCTIONS PROTOTYPES */
+
+static const uart_port_t * Uart_Port(USART_TypeDef *UARTx);
+static uint32_t Uart_Get_PCLK(const uart_port_t *port);
+static uart_status_e Uart_Baud(uint32_t pclk, uint32_t baud, uart_baud_t *result);
+static void Uart_Port_Config(const uart_port_t *port, uint32_t baud, uart_remap_e remap);
+static void Uart_IRQ(const uart_port_t *port);
+static void Uart_Error_IRQ(const uart_port_t *port, uint32_t sr);
+static void Uart_DMA_TX_Init(const uart_port_t *port);
+static void Uart_DMA_TX_Push(const uart_port_t *port, const uint8_t *data, uint16_t length, uint16_t notify, volatile message_buffer_t *msg_buffer);
+static void Uart_DMA_TX_Start(const uart_port_t *port);
+static void Uart_DMA_TX_IRQ(const uart_port_t *port);
+static void Uart_DMA_RX_Process(const uart_port_t *port);
+static void Uart_DMA_RX_IRQ(const uart_port_t *port);
 
 /* ####################################################### */
 
@@ -68,85 +233,52 @@ Uart_RX_CallbackFunc_t uart3_rx_callback;
  * */
 void Uart_config(USART_TypeDef *UARTx, uint32_t baud, uart_remap_e remap, Uart_RX_CallbackFunc_t callback)
 {
-    switch((uint32_t)UARTx)
-    {
-        case (uint32_t)USART1:
-            Uart1_config(baud, remap);
-            uart1_rx_callback = callback;
-            break;
-        case (uint32_t)USART2:
-            Uart2_config(baud);
-            uart2_rx_callback = callback;
-            break;
-        case (uint32_t)USART3:
-            Uart3_config(baud);
-            uart3_rx_callback = callback;
-            break;
-    }
+    const uart_port_t *port = Uart_Port(UARTx);
+
+    if(!port)
+        return;
+
+    port->state->rx_callback = callback;
+    Uart_Port_Config(port, baud, remap);
 }
 
 void Uart_change_baud(USART_TypeDef *UARTx, uint32_t baud)
 {
-    switch((uint32_t)UARTx)
-    {
-    	case (uint32_t)USART1:
-			// Disable interrupts
-    		__disable_irq();
-
-			// Disable UART
-			UARTx->CR1 &= ~(USART_CR1_UE);
-
-			// Config Baud
-			UARTx->BRR =  ((SystemCoreClock + (baud/2U))/baud);
-
-			// Enable UART
-			UARTx->CR1 |= USART_CR1_UE;
-
-			// Enable interrupts
-			__enable_irq();
-
-		break;
-
-    	case (uint32_t)USART2:
-
-			// Disable interrupts
-			__disable_irq();
-
-			// Disable UART
-			UARTx->CR1 &= ~(USART_CR1_UE);
-
-			// Config Baud
-			UARTx->BRR =  (((SystemCoreClock/2) + (baud/2U))/baud);
+    const uart_port_t *port = Uart_Port(UARTx);
+    uart_baud_t solved;
 
-			// Enable UART
-			UARTx->CR1 |= USART_CR1_UE;
+    if(!port)
+        return;
 
-			// Enable interrupts
-			__enable_irq();
+    if(UART_OK != Uart_Baud(Uart_Get_PCLK(port), baud, &solved))
+        return;
 
-		break;
+    // Disable interrupts
+    __disable_irq();
 
-        case (uint32_t)USART3:
+    // Disable UART
+    UARTx->CR1 &= ~(USART_CR1_UE);
 
-			// Disable interrupts
-			__disable_irq();
+    // Config Baud
+    UARTx->BRR = solved.brr;
 
-			// Disable UART
-			UARTx->CR1 &= ~(USART_CR1_UE);
+    // Enable UART
+    UARTx->CR1 |= USART_CR1_UE;
 
-			// Config Baud
-			UARTx->BRR =  (((SystemCoreClock/2) + (baud/2U))/baud);
+    // Enable interrupts
+    __enable_irq();
 
-			// Enable UART
-			UARTx->CR1 |= USART_CR1_UE;
+}// end Uart_change_baud
 
-			// Enable interrupts
-			__enable_irq();
+uart_status_e Uart_Solve_Baud(USART_TypeDef *UARTx, uint32_t baud, uart_baud_t *result)
+{
+    const uart_port_t *port = Uart_Port(UARTx);
 
-		break;
-    }
+    if(!port || !result)
+        return UART_ERR;
 
-}// end Uart_change_baud
+    return Uart_Baud(Uart_Get_PCLK(port), baud, result);
+}
 
 void Uart_Disable(USART_TypeDef *UARTx)
 {
@@ -175,8 +307,52 @@ void Uart_Enable(USART_TypeDef *UARTx)
     // Enable Uart
 	UARTx->CR1 |= USART_CR1_UE;
 
-    // RXNE Interrupt Enable
-	UARTx->CR1 |= USART_CR1_RXNEIE;
+    // RXNE Interrupt Enable (the DMA reads the data if DMAR is set)
+	if(0 == (UARTx->CR3 & USART_CR3_DMAR))
+		UARTx->CR1 |= USART_CR1_RXNEIE;
+}
+
+void Uart_Set_Error_Callback(USART_TypeDef *UARTx, Uart_Error_CallbackFunc_t callback)
+{
+    const uart_port_t *port = Uart_Port(UARTx);
+
+    if(port)
+        port->state->error_callback = callback;
+}
+
+void Uart_Get_Errors(USART_TypeDef *UARTx, uart_errors_t *errors)
+{
+    const uart_port_t *port = Uart_Port(UARTx);
+
+    if(!port || !errors)
+        return;
+
+    errors->parity = port->state->errors.parity;
+    errors->framing = port->state->errors.framing;
+    errors->noise = port->state->errors.noise;
+    errors->overrun = port->state->errors.overrun;
+    errors->dma_tx = port->state->errors.dma_tx;
+}
+
+void Uart_Clear_Errors(USART_TypeDef *UARTx)
+{
+    const uart_port_t *port = Uart_Port(UARTx);
+    uint32_t primask;
+
+    if(!port)
+        return;
+
+    // The interrupts increment the counters: an increment between their read and store would be lost
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    port->state->errors.parity = 0;
+    port->state->errors.framing = 0;
+    port->state->errors.noise = 0;
+    port->state->errors.overrun = 0;
+    port->state->errors.dma_tx = 0;
+
+    __set_PRIMASK(primask);
 }
 
 uart_status_e Uart_Write_Byte(USART_TypeDef *UARTx, uint8_t data)
@@ -234,210 +410,600 @@ uart_status_e Uart_Write_Text(USART_TypeDef *UARTx, char *text)
 }
 
 
-/* ####################################################### */
+uart_status_e Uart_Write_Array_DMA(USART_TypeDef *UARTx, const uint8_t *array, uint16_t length)
+{
+    const uart_port_t *port = Uart_Port(UARTx);
+    volatile uart_state_t *state;
+    uart_status_e status = UART_ERR;
+    uint32_t primask;
 
-/* PRIVATE FUNCTIONS */
+    if(!port || !port->dma || !array || (0 == length))
+        return UART_ERR;
 
-/*
- * remap:UART_NO_REMAP  : TX/PA9, RX/PA10
- * remap:UART_REMAP     : TX/PB6, RX/PB7
- */
-static void Uart1_config(uint32_t baud, uart_remap_e remap)
-{
-    if(UART_REMAP == remap)
-    {
-        /* TX/PB6, RX/PB7 */
+    // verify if uart or tx is not enabled
+    if((UARTx->CR1 & (USART_CR1_UE | USART_CR1_TE)) != (USART_CR1_UE | USART_CR1_TE))
+        return UART_ERR;
 
-        // Enable clock access to GPIOB
-        RCC->APB2ENR |= RCC_APB2ENR_IOPBEN;
-        // Enable clock access to alternate function
-        RCC->APB2ENR |= RCC_APB2ENR_AFIOEN;
-        // Enable clock access to USART1
-        RCC->APB2ENR |= RCC_APB2ENR_USART1EN;
+    if(0 == (UARTx->CR3 & USART_CR3_DMAT))
+        Uart_DMA_TX_Init(port);
 
-        // PB6 as output max speed 50MHz
-        GPIOB->CRL |= GPIO_CRL_MODE6;
+    state = port->state;
 
-        // PB6 as AF Push-Pull
-        GPIOB->CRL |=  GPIO_CRL_CNF6_1;
-        GPIOB->CRL &= ~GPIO_CRL_CNF6_0;
+    primask = __get_PRIMASK();
+    __disable_irq();
 
-        // Remap
-        AFIO->MAPR |= AFIO_MAPR_USART1_REMAP;
-    }
-    else if (UART_NO_REMAP == remap)
+    // Queue not full
+    if(((state->tx_last + 1) & (UART_DMA_TX_QUEUE - 1)) != state->tx_first)
     {
-        /* TX/PA9, RX/PA10 */
+        Uart_DMA_TX_Push(port, array, length, length, NULL);
 
-        // Enable clock access to GPIOA
-        RCC->APB2ENR |= RCC_APB2ENR_IOPAEN;
-        // Enable clock access to alternate function
-        RCC->APB2ENR |= RCC_APB2ENR_AFIOEN;
-        // Enable clock access to USART1
-        RCC->APB2ENR |= RCC_APB2ENR_USART1EN;
+        if(!state->tx_busy)
+            Uart_DMA_TX_Start(port);
 
-        // PA9 as output max speed 50MHz
-        GPIOA->CRH |= GPIO_CRH_MODE9;
+        status = UART_OK;
+    }
 
-        // PA9 as AF Push-Pull
-        GPIOA->CRH |=  GPIO_CRH_CNF9_1;
-        GPIOA->CRH &= ~GPIO_CRH_CNF9_0;
+    __set_PRIMASK(primask);
 
-        // Dont Remap
-        AFIO->MAPR&=~AFIO_MAPR_USART1_REMAP;
-    }
+    return status;
+}
 
+uart_status_e Uart_Write_Message_DMA(USART_TypeDef *UARTx, volatile message_buffer_t *msg_buffer)
+{
+    const uart_port_t *port = Uart_Port(UARTx);
+    volatile uart_state_t *state;
+    uart_status_e status = UART_ERR;
+    const uint8_t *part1;
+    const uint8_t *part2;
+    uint16_t length1;
+    uint16_t length2;
+    uint8_t free_slots;
+    uint32_t primask;
+
+    if(!port || !port->dma || !msg_buffer)
+        return UART_ERR;
 
-    // Transmit Enable
-    USART1->CR1 |= USART_CR1_TE;
+    // verify if uart or tx is not enabled
+    if((UARTx->CR1 & (USART_CR1_UE | USART_CR1_TE)) != (USART_CR1_UE | USART_CR1_TE))
+        return UART_ERR;
 
-    // Receive Enable
-    USART1->CR1 |= USART_CR1_RE;
+    if(0 == (UARTx->CR3 & USART_CR3_DMAT))
+        Uart_DMA_TX_Init(port);
 
-    // Config Mantissa and Fraction
-    USART1->BRR =  ((SystemCoreClock + (baud/2U))/baud);
+    state = port->state;
 
-    // Enable Uart 1
-    USART1->CR1 |= USART_CR1_UE;
+    primask = __get_PRIMASK();
+    __disable_irq();
 
-    // RXNE Interrupt Enable
-    USART1->CR1 |= USART_CR1_RXNEIE;
+    free_slots = (state->tx_first - state->tx_last - 1) & (UART_DMA_TX_QUEUE - 1);
 
-    // Enable USART Interrupt
-    NVIC_EnableIRQ(USART1_IRQn);
+    if(!state->tx_msg_pending
+        && (BUFFER_OK == Message_Buffer_Peek_Message_Spans(msg_buffer, &part1, &length1, &part2, &length2)))
+    {
+        if(0 == length1)
+        {
+            // Empty message: nothing to send
+            Message_Buffer_Drop_Message(msg_buffer);
+            status = UART_OK;
+        }
+        else if(free_slots >= ((length2 != 0) ? 2 : 1))
+        {
+            // A message that wraps the buffer storage is sent by two transfers
+            if(length2 != 0)
+            {
+                Uart_DMA_TX_Push(port, part1, length1, 0, NULL);
+                Uart_DMA_TX_Push(port, part2, length2, length1 + length2, msg_buffer);
+            }
+            else
+            {
+                Uart_DMA_TX_Push(port, part1, length1, length1, msg_buffer);
+            }
+
+            state->tx_msg_pending = 1;
+
+            if(!state->tx_busy)
+                Uart_DMA_TX_Start(port);
+
+            status = UART_OK;
+        }
+        else
+        {
+            /* do nothing */
+        }
+    }
+
+    __set_PRIMASK(primask);
+
+    return status;
 }
 
-static void Uart2_config(uint32_t baud)
+void Uart_Set_TX_Callback(USART_TypeDef *UARTx, Uart_TX_CallbackFunc_t callback)
 {
-    /* TX/PA2, RX/PA3 */
+    const uart_port_t *port = Uart_Port(UARTx);
 
-    // Enable clock access to GPIOA
-    RCC->APB2ENR |= RCC_APB2ENR_IOPAEN;
-    // Enable clock access to alternate function
-    RCC->APB2ENR |= RCC_APB2ENR_AFIOEN;
-    // Enable clock access to USART2
-    RCC->APB1ENR |= RCC_APB1ENR_USART2EN;
-    // PA2 as output max speed 50MHz
-    GPIOA->CRL |= GPIO_CRL_MODE2;
+    if(port)
+        port->state->tx_callback = callback;
+}
 
-    // PA9 as AF Push-Pull
-    GPIOA->CRL |=  GPIO_CRL_CNF2;
-    GPIOA->CRL &= ~GPIO_CRL_CNF2_0;
+uint8_t Uart_TX_DMA_Busy(USART_TypeDef *UARTx)
+{
+    const uart_port_t *port = Uart_Port(UARTx);
 
-    // Dont Remap
-    AFIO->MAPR&=~AFIO_MAPR_USART2_REMAP;
+    return (port) ? port->state->tx_busy : 0;
+}
 
+uart_status_e Uart_Config_RX_DMA(USART_TypeDef *UARTx, uint8_t *storage, uint16_t size, Uart_RX_Chunk_CallbackFunc_t callback)
+{
+    const uart_port_t *port = Uart_Port(UARTx);
+    volatile uart_state_t *state;
+    DMA_Channel_TypeDef *channel;
 
-    //Transmit Enable
-    USART2->CR1 |= USART_CR1_TE;
+    if(!port || !port->dma || !storage || (0 == size) || !callback)
+        return UART_ERR;
 
-    // Receive Enable
-    USART2->CR1 |= USART_CR1_RE;
+    state = port->state;
+    channel = port->dma_rx;
 
-    // Config Mantissa and Fraction
-    USART2->BRR =  (((SystemCoreClock/2) + (baud/2U))/baud);
+    // Enable clock access to DMA
+    RCC->AHBENR |= port->dma_en;
 
-    // Enable Uart
-    USART2->CR1 |= USART_CR1_UE;
+    // RXNE Interrupt Disable: the DMA reads the data
+    UARTx->CR1 &= ~USART_CR1_RXNEIE;
 
-    // RXNE Interrupt Enable
-    USART2->CR1 |= USART_CR1_RXNEIE;
+    channel->CCR = 0;
+    port->dma->IFCR = DMA_IFCR_CGIF1 << port->dma_rx_shift;
 
-    // Enable USART Interrupt
-    NVIC_EnableIRQ(USART2_IRQn);
+    state->rx_storage = storage;
+    state->rx_size = size;
+    state->rx_read = 0;
+    state->rx_chunk_callback = callback;
+
+    // Peripheral to memory, memory increment, circular, 8 bit, HT and TC interrupts
+    channel->CPAR = (uint32_t)&UARTx->DR;
+    channel->CMAR = (uint32_t)storage;
+    channel->CNDTR = size;
+    channel->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE;
+    channel->CCR |= DMA_CCR_EN;
+
+    // DMA Receive Enable
+    UARTx->CR3 |= USART_CR3_DMAR;
+
+    // Error Interrupt Enable (FE, NE, ORE are not seen through RXNE anymore)
+    UARTx->CR3 |= USART_CR3_EIE;
+
+    // IDLE Interrupt Enable
+    UARTx->CR1 |= USART_CR1_IDLEIE;
+
+    // Enable DMA Interrupt
+    NVIC_EnableIRQ(port->dma_rx_irq);
+
+    return UART_OK;
 }
 
 
-static void Uart3_config(uint32_t baud)
+/* ####################################################### */
+
+/* PRIVATE FUNCTIONS */
+
+static const uart_port_t * Uart_Port(USART_TypeDef *UARTx)
 {
-    /* TX/PB10, RX/PB11 */
+    uint8_t index = uart_port_index[UART_PORT_KEY(UARTx)];
 
-    // Enable clock access to GPIOA
-    RCC->APB2ENR |= RCC_APB2ENR_IOPBEN;
-    // Enable clock access to alternate function
-    RCC->APB2ENR |= RCC_APB2ENR_AFIOEN;
-    // Enable clock access to USART
-    RCC->APB1ENR |= RCC_APB1ENR_USART3EN;
+    if((index >= UART_PORTS) || (uart_ports[index].uart != UARTx))
+        return NULL;
+
+    return &uart_ports[index];
+}
+
+// USART1 is on APB2 (PCLK2), the others on APB1 (PCLK1)
+static uint32_t Uart_Get_PCLK(const uart_port_t *port)
+{
+    // HCLK from the current RCC configuration
+    SystemCoreClockUpdate();
+
+    return SystemCoreClock >> APBPrescTable[(RCC->CFGR >> port->ppre_pos) & 0x7];
+}
+
+/*
+ * baud = pclk / (BRR / 16), BRR from 16 (USARTDIV 1.0) to 0xFFFF.
+ * Rounding pclk / baud gives the closest BRR, but the baud error is
+ * |pclk - baud * BRR| / BRR, so the next BRR values are compared too.
+ */
+static uart_status_e Uart_Baud(uint32_t pclk, uint32_t baud, uart_baud_t *result)
+{
+    uint64_t best_diff = 0;
+    uint32_t best = 0;
+    uint32_t brr;
+    int64_t error;
+    int64_t scale;
 
-    // PB10 as output max speed 50MHz
-    GPIOB->CRH |= GPIO_CRH_MODE10;
+    if(0 == baud)
+        return UART_ERR;
 
-    // PA9 as AF Push-Pull
-    GPIOB->CRH |=  GPIO_CRH_CNF10_1;
-    GPIOB->CRH &= ~GPIO_CRH_CNF10_0;
+    brr = (pclk + (baud/2U))/baud;
 
-    // Dont Remap
-    AFIO->MAPR&=~AFIO_MAPR_USART3_REMAP;
+    for(uint32_t candidate = (brr > 0) ? (brr - 1) : 0; candidate <= brr + 1; candidate++)
+    {
+        uint64_t product;
+        uint64_t diff;
 
+        if((candidate < 16) || (candidate > 0xFFFF))
+            continue;
 
+        product = (uint64_t)baud * candidate;
+        diff = (product > pclk) ? (product - pclk) : (pclk - product);
 
-    //Transmit Enable
-    USART3->CR1 |= USART_CR1_TE;
+        // diff / candidate < best_diff / best
+        if(!best || (diff * best < best_diff * candidate))
+        {
+            best = candidate;
+            best_diff = diff;
+        }
+    }
+
+    if(!best)
+        return UART_ERR;
+
+    result->brr = (uint16_t)best;
+    result->baud = (pclk + (best/2U))/best;
+
+    // (pclk / best - baud) / baud * 1e6, rounded
+    error = ((int64_t)pclk - (int64_t)baud * best) * 1000000;
+    scale = (int64_t)baud * best;
+    result->error_ppm = (int32_t)((error + ((error < 0) ? -scale/2 : scale/2)) / scale);
+
+    return UART_OK;
+}
+
+/*
+ * TX pin as AF Push-Pull, output max speed 50MHz. RX pin is left as input
+ * floating (reset state).
+ */
+static void Uart_Port_Config(const uart_port_t *port, uint32_t baud, uart_remap_e remap)
+{
+    USART_TypeDef *uart = port->uart;
+    uart_baud_t solved;
+    GPIO_TypeDef *gpio;
+    volatile uint32_t *gpio_cr;
+    uint8_t shift;
+
+    // Remap unsupported by the port: use the default pins
+    if((UART_REMAP != remap) || !port->tx_port[UART_REMAP])
+        remap = UART_NO_REMAP;
+
+    gpio = port->tx_port[remap];
+    gpio_cr = (port->tx_pin[remap] < 8) ? &gpio->CRL : &gpio->CRH;
+    shift = (port->tx_pin[remap] & 0x7) * 4;
+
+    // Enable clock access to GPIO and alternate function
+    RCC->APB2ENR |= port->tx_port_en[remap] | RCC_APB2ENR_AFIOEN;
+    // Enable clock access to USART
+    *port->rcc_enr |= port->rcc_en;
+
+    // TX: MODE = 11 (50MHz), CNF = 10 (AF Push-Pull)
+    *gpio_cr = (*gpio_cr & ~(0xFUL << shift)) | (0xBUL << shift);
+
+    // Remap
+    if(UART_REMAP == remap)
+        AFIO->MAPR |= port->remap;
+    else
+        AFIO->MAPR &= ~port->remap;
+
+
+    // Transmit Enable
+    uart->CR1 |= USART_CR1_TE;
 
     // Receive Enable
-    USART3->CR1 |= USART_CR1_RE;
+    uart->CR1 |= USART_CR1_RE;
 
     // Config Mantissa and Fraction
-    USART3->BRR =  (((SystemCoreClock/2) + (baud/2U))/baud);
+    if(UART_OK == Uart_Baud(Uart_Get_PCLK(port), baud, &solved))
+        uart->BRR = solved.brr;
 
     // Enable Uart
-    USART3->CR1 |= USART_CR1_UE;
+    uart->CR1 |= USART_CR1_UE;
 
     // RXNE Interrupt Enable
-    USART3->CR1 |= USART_CR1_RXNEIE;
+    uart->CR1 |= USART_CR1_RXNEIE;
+
+    // Error Interrupt Enable (PE, and FE/NE/ORE also with DMA reception)
+    uart->CR1 |= USART_CR1_PEIE;
+    uart->CR3 |= USART_CR3_EIE;
 
     // Enable USART Interrupt
-    NVIC_EnableIRQ(USART3_IRQn);
+    NVIC_EnableIRQ(port->irq);
 }
 
-/* ####################################################### */
+static void Uart_IRQ(const uart_port_t *port)
+{
+    USART_TypeDef *uart = port->uart;
+    volatile uart_state_t *state = port->state;
+    uint32_t sr = uart->SR;
+    uint8_t idle = ((sr & USART_SR_IDLE) && (uart->CR1 & USART_CR1_IDLEIE));
 
-/* INTERRUPT HANDLERS */
+    // PE, FE, NE, ORE: the flags are cleared by the DR read below
+    if(sr & UART_ERROR_ALL)
+        Uart_Error_IRQ(port, sr);
 
-void USART1_IRQHandler(void)
-{
-    // RXNE: Received data ready to be read
-    if( (USART1->SR & USART_SR_RXNE) == USART_SR_RXNE )
+    // RXNE: Received data ready to be read (not with DMA reception)
+    if( (sr & USART_SR_RXNE) && (uart->CR1 & USART_CR1_RXNEIE) )
     {
-        if(uart1_rx_callback)
+        if(state->rx_callback)
         {
-            uart1_rx_callback((uint8_t)USART1->DR);
+            state->rx_callback((uint8_t)uart->DR);
         }
         else
         {
-            (void)USART1->DR; // just read
+            (void)uart->DR; // just read
         }
     }
+    // ORE without RXNE (DR read before the overrun was seen), DMA reception or IDLE:
+    // clear the flags, otherwise the interrupt keeps firing. A received byte is
+    // left to the DMA, whose DR read after our SR read clears them too
+    else if( (sr & UART_ERROR_ALL) || idle )
+    {
+        if( !((uart->CR3 & USART_CR3_DMAR) && (sr & USART_SR_RXNE)) )
+            (void)uart->DR;
+    }
+    else
+    {
+        /* do nothing */
+    }
+
+    // IDLE: line idle after a burst, the DMA may have bytes not given yet
+    if(idle)
+        Uart_DMA_RX_Process(port);
 }
 
-void USART2_IRQHandler(void)
+static void Uart_Error_IRQ(const uart_port_t *port, uint32_t sr)
+{
+    volatile uart_state_t *state = port->state;
+
+    if(sr & UART_ERROR_PARITY)
+        state->errors.parity++;
+
+    if(sr & UART_ERROR_FRAMING)
+        state->errors.framing++;
+
+    if(sr & UART_ERROR_NOISE)
+        state->errors.noise++;
+
+    if(sr & UART_ERROR_OVERRUN)
+        state->errors.overrun++;
+
+    if(state->error_callback)
+        state->error_callback((uint8_t)(sr & UART_ERROR_ALL));
+}
+
+static void Uart_DMA_TX_Init(const uart_port_t *port)
+{
+    DMA_Channel_TypeDef *channel = port->dma_tx;
+
+    // Enable clock access to DMA
+    RCC->AHBENR |= port->dma_en;
+
+    // Memory to peripheral, memory increment, 8 bit, TC and TE interrupts
+    channel->CCR = 0;
+    channel->CPAR = (uint32_t)&port->uart->DR;
+    channel->CCR = DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_TCIE | DMA_CCR_TEIE;
+    port->dma->IFCR = DMA_IFCR_CGIF1 << port->dma_tx_shift;
+
+    // DMA Transmit Enable
+    port->uart->CR3 |= USART_CR3_DMAT;
+
+    // Enable DMA Interrupt
+    NVIC_EnableIRQ(port->dma_tx_irq);
+}
+
+// Must be called with the interrupts disabled
+static void Uart_DMA_TX_Push(const uart_port_t *port, const uint8_t *data, uint16_t length, uint16_t notify, volatile message_buffer_t *msg_buffer)
 {
-    // RXNE: Received data ready to be read
-    if ((USART2->SR & USART_SR_RXNE) == USART_SR_RXNE)
+    volatile uart_state_t *state = port->state;
+    volatile uart_dma_tx_t *tx = &state->tx_queue[state->tx_last];
+
+    tx->data = data;
+    tx->length = length;
+    tx->notify = notify;
+    tx->msg_buffer = msg_buffer;
+
+    state->tx_last = (state->tx_last + 1) & (UART_DMA_TX_QUEUE - 1);
+}
+
+// Starts the transfer at tx_first (the queue must not be empty)
+static void Uart_DMA_TX_Start(const uart_port_t *port)
+{
+    volatile uart_state_t *state = port->state;
+    volatile uart_dma_tx_t *tx = &state->tx_queue[state->tx_first];
+    DMA_Channel_TypeDef *channel = port->dma_tx;
+
+    // CMAR and CNDTR can only be written with the channel disabled
+    channel->CCR &= ~DMA_CCR_EN;
+    channel->CMAR = (uint32_t)tx->data;
+    channel->CNDTR = tx->length;
+    channel->CCR |= DMA_CCR_EN;
+
+    state->tx_busy = 1;
+}
+
+static void Uart_DMA_TX_IRQ(const uart_port_t *port)
+{
+    volatile uart_state_t *state = port->state;
+    volatile uart_dma_tx_t *tx;
+    volatile message_buffer_t *msg_buffer;
+    const uint8_t *data;
+    uint16_t notify;
+    uint32_t isr = (port->dma->ISR >> port->dma_tx_shift);
+    uint8_t failed = (0 != (isr & DMA_ISR_TEIF1));
+
+    // TC: transfer complete, TE: transfer error (the channel is disabled by hardware)
+    if(0 == (isr & (DMA_ISR_TCIF1 | DMA_ISR_TEIF1)))
+        return;
+
+    port->dma->IFCR = DMA_IFCR_CGIF1 << port->dma_tx_shift;
+    port->dma_tx->CCR &= ~DMA_CCR_EN;
+
+    if(!state->tx_busy)
+        return;
+
+    tx = &state->tx_queue[state->tx_first];
+    data = tx->data;
+    notify = tx->notify;
+    msg_buffer = tx->msg_buffer;
+
+    state->tx_first = (state->tx_first + 1) & (UART_DMA_TX_QUEUE - 1);
+
+    // First part of a wrapped message (no callback): do not send the second part either
+    if(failed && (0 == notify) && !msg_buffer)
     {
-        if(uart2_rx_callback)
-        {
-            uart2_rx_callback((uint8_t)USART2->DR);
-        }
-        else
-        {
-            (void)USART2->DR; // just read
-        }
+        msg_buffer = state->tx_queue[state->tx_first].msg_buffer;
+        state->tx_first = (state->tx_first + 1) & (UART_DMA_TX_QUEUE - 1);
+    }
+
+    // A message is removed from msg_buffer only once it is sent
+    if(msg_buffer)
+    {
+        if(!failed)
+            Message_Buffer_Drop_Message(msg_buffer);
+
+        state->tx_msg_pending = 0;
+    }
+
+    // Start the next transfer before the callback, so the line does not go idle
+    if(state->tx_first != state->tx_last)
+        Uart_DMA_TX_Start(port);
+    else
+        state->tx_busy = 0;
+
+    if(failed)
+    {
+        state->errors.dma_tx++;
+
+        if(state->error_callback)
+            state->error_callback(UART_ERROR_DMA_TX);
+    }
+    else if(notify && state->tx_callback)
+    {
+        state->tx_callback((msg_buffer) ? NULL : data, notify);
+    }
+    else
+    {
+        /* do nothing */
     }
 }
 
-void USART3_IRQHandler(void)
+// Gives the bytes written by the DMA since the last call to the callback
+static void Uart_DMA_RX_Process(const uart_port_t *port)
 {
-    // RXNE: Received data ready to be read
-    if ((USART3->SR & USART_SR_RXNE) == USART_SR_RXNE)
+    volatile uart_state_t *state = port->state;
+    uint16_t i_read = state->rx_read;
+    uint16_t i_write;
+
+    if(!state->rx_chunk_callback)
+        return;
+
+    // CNDTR counts down from size and is reloaded at the end of storage
+    i_write = state->rx_size - port->dma_rx->CNDTR;
+
+    if(i_write == state->rx_size)
+        i_write = 0;
+
+    if(i_write == i_read)
+        return;
+
+    state->rx_read = i_write;
+
+    if(i_write > i_read)
     {
-        if(uart3_rx_callback)
-        {
-            uart3_rx_callback((uint8_t)USART3->DR);
-        }
-        else
-        {
-            (void)USART3->DR;
-        }
+        state->rx_chunk_callback(&state->rx_storage[i_read], i_write - i_read);
+    }
+    else
+    {
+        state->rx_chunk_callback(&state->rx_storage[i_read], state->rx_size - i_read);
+
+        if(i_write)
+            state->rx_chunk_callback(&state->rx_storage[0], i_write);
     }
 }
+
+static void Uart_DMA_RX_IRQ(const uart_port_t *port)
+{
+    // HT: half of storage written, TC: end of storage written
+    if(0 == ((port->dma->ISR >> port->dma_rx_shift) & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1)))
+        return;
+
+    port->dma->IFCR = (DMA_IFCR_CHTIF1 | DMA_IFCR_CTCIF1) << port->dma_rx_shift;
+
+    Uart_DMA_RX_Process(port);
+}
+
+/* ####################################################### */
+
+/* INTERRUPT HANDLERS */
+
+void USART1_IRQHandler(void)
+{
+    Uart_IRQ(&uart_ports[UART_PORT_1]);
+}
+
+void USART2_IRQHandler(void)
+{
+    Uart_IRQ(&uart_ports[UART_PORT_2]);
+}
+
+void USART3_IRQHandler(void)
+{
+    Uart_IRQ(&uart_ports[UART_PORT_3]);
+}
+
+void DMA1_Channel4_IRQHandler(void)
+{
+    Uart_DMA_TX_IRQ(&uart_ports[UART_PORT_1]);
+}
+
+void DMA1_Channel7_IRQHandler(void)
+{
+    Uart_DMA_TX_IRQ(&uart_ports[UART_PORT_2]);
+}
+
+void DMA1_Channel2_IRQHandler(void)
+{
+    Uart_DMA_TX_IRQ(&uart_ports[UART_PORT_3]);
+}
+
+void DMA1_Channel5_IRQHandler(void)
+{
+    Uart_DMA_RX_IRQ(&uart_ports[UART_PORT_1]);
+}
+
+void DMA1_Channel6_IRQHandler(void)
+{
+    Uart_DMA_RX_IRQ(&uart_ports[UART_PORT_2]);
+}
+
+void DMA1_Channel3_IRQHandler(void)
+{
+    Uart_DMA_RX_IRQ(&uart_ports[UART_PORT_3]);
+}
+
+#if defined(UART4)
+void UART4_IRQHandler(void)
+{
+    Uart_IRQ(&uart_ports[UART_PORT_4]);
+}
+
+void UART5_IRQHandler(void)
+{
+    Uart_IRQ(&uart_ports[UART_PORT_5]);
+}
+
+// DMA2 channel 4 is not used by the UARTs
+void DMA2_Channel4_5_IRQHandler(void)
+{
+    Uart_DMA_TX_IRQ(&uart_ports[UART_PORT_4]);
+}
+
+void DMA2_Channel3_IRQHandler(void)
+{
+    Uart_DMA_RX_IRQ(&uart_ports[UART_PORT_4]);
+}
+#endif
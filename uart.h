@@ -2,6 +2,12 @@
 #define UART_H_
 
 #include "stm32f1xx.h"
+#include "message_buffer.h"
+
+// Quantity of DMA transfers that can be queued per port (2^N value)
+#ifndef UART_DMA_TX_QUEUE
+#define UART_DMA_TX_QUEUE   4
+#endif
 
 /*
  * FOR STM32F103C8T6:
@@ -30,16 +36,122 @@ typedef enum
     UART_ERR
 }uart_status_e;
 
+// Baud rate given by a USART_BRR value
+typedef struct
+{
+    uint16_t brr;           // USART_BRR value (12 bits mantissa, 4 bits fraction)
+    uint32_t baud;          // achieved baud rate
+    int32_t error_ppm;      // (achieved - requested) / requested, in ppm
+}uart_baud_t;
+
+// RX error flags (same bits as USART_SR)
+#define UART_ERROR_PARITY   USART_SR_PE
+#define UART_ERROR_FRAMING  USART_SR_FE
+#define UART_ERROR_NOISE    USART_SR_NE
+#define UART_ERROR_OVERRUN  USART_SR_ORE
+#define UART_ERROR_ALL      (UART_ERROR_PARITY | UART_ERROR_FRAMING | UART_ERROR_NOISE | UART_ERROR_OVERRUN)
+
+// DMA TX transfer error flag (not a USART_SR bit)
+#define UART_ERROR_DMA_TX   0x80
+
+// RX error counters of a port
+typedef struct
+{
+    uint32_t parity;
+    uint32_t framing;
+    uint32_t noise;
+    uint32_t overrun;
+    uint32_t dma_tx;        // DMA TX transfer errors
+}uart_errors_t;
+
 // Function pointer for RX interrupt callback
 typedef void (*Uart_RX_CallbackFunc_t )(uint8_t);
 
+// Function pointer for RX and DMA TX error callback (errors: UART_ERROR_* flags)
+typedef void (*Uart_Error_CallbackFunc_t )(uint8_t errors);
+
+// Function pointer for DMA TX complete callback (data is NULL for messages)
+typedef void (*Uart_TX_CallbackFunc_t )(const uint8_t *data, uint16_t length);
+
+// Function pointer for DMA RX chunk callback
+typedef void (*Uart_RX_Chunk_CallbackFunc_t )(const uint8_t *data, uint16_t length);
+
 void Uart_config(USART_TypeDef *UARTx, uint32_t baud, uart_remap_e remap, Uart_RX_CallbackFunc_t callback);
 void Uart_change_baud(USART_TypeDef *UARTx, uint32_t baud);
+
+/*
+ * Finds the USART_BRR value closest to baud, for the port clock (PCLK1, or
+ * PCLK2 for USART1) of the current RCC configuration, and the baud rate and
+ * error it gives. Nothing is written to the USART.
+ *
+ * Returns UART_ERR if baud is out of range (above PCLK/16 or below PCLK/65535).
+ * Uart_config and Uart_change_baud use the same BRR value (and leave BRR
+ * unchanged if baud is out of range).
+ * */
+uart_status_e Uart_Solve_Baud(USART_TypeDef *UARTx, uint32_t baud, uart_baud_t *result);
 void Uart_Disable(USART_TypeDef *UARTx);
 void Uart_Enable(USART_TypeDef *UARTx);
 
+/*
+ * RX ERRORS
+ *
+ * Parity, framing, noise and overrun errors are counted in the USART interrupt
+ * and cleared there (read SR then DR), then the error callback is called with
+ * the flags, before the received byte is given to the RX callback. The byte
+ * received with the error is still given to the RX callback (with DMA
+ * reception, the DMA stores it and its DR read clears the flags).
+ * */
+void Uart_Set_Error_Callback(USART_TypeDef *UARTx, Uart_Error_CallbackFunc_t callback);
+void Uart_Get_Errors(USART_TypeDef *UARTx, uart_errors_t *errors);
+void Uart_Clear_Errors(USART_TypeDef *UARTx);
+
 uart_status_e Uart_Write_Byte(USART_TypeDef *UARTx, uint8_t ch);
 uart_status_e Uart_Write_Array(USART_TypeDef *UARTx, uint8_t *array, uint16_t length);
 uart_status_e Uart_Write_Text(USART_TypeDef *UARTx, char *text);
 
+/*
+ * DMA TRANSMISSION (USART1: DMA1 CH4, USART2: DMA1 CH7, USART3: DMA1 CH2,
+ *                   UART4: DMA2 CH5 on high-density parts, UART5: none)
+ *
+ * The data is sent from where it is, without a copy, so it must not change
+ * until the transfer is complete. Transfers written while the DMA is busy are
+ * queued (up to UART_DMA_TX_QUEUE) and started from the DMA interrupt, then
+ * the TX callback is called once per write. UART_ERR is returned if the queue
+ * is full.
+ *
+ * Uart_Write_Message_DMA sends the oldest message of msg_buffer in place and
+ * removes it from the buffer when it is sent, so the DMA interrupt is the
+ * reader of msg_buffer until then. Only one message per port is sent at a time.
+ *
+ * On a DMA transfer error (TE: the data address could not be read) the
+ * transfer is abandoned: it is counted in uart_errors_t.dma_tx, the error
+ * callback is called with UART_ERROR_DMA_TX instead of the TX callback, and
+ * the next queued transfer is started. A message is left in msg_buffer, so
+ * Uart_Write_Message_DMA can send it again (or the caller can drop it).
+ *
+ * Do not mix with Uart_Write_Byte/Array/Text while Uart_TX_DMA_Busy.
+ * */
+uart_status_e Uart_Write_Array_DMA(USART_TypeDef *UARTx, const uint8_t *array, uint16_t length);
+uart_status_e Uart_Write_Message_DMA(USART_TypeDef *UARTx, volatile message_buffer_t *msg_buffer);
+void Uart_Set_TX_Callback(USART_TypeDef *UARTx, Uart_TX_CallbackFunc_t callback);
+uint8_t Uart_TX_DMA_Busy(USART_TypeDef *UARTx);
+
+/*
+ * DMA RECEPTION (USART1: DMA1 CH5, USART2: DMA1 CH6, USART3: DMA1 CH3,
+ *                UART4: DMA2 CH3 on high-density parts, UART5: none)
+ *
+ * Call after Uart_config. The DMA writes the received bytes continuously into
+ * storage (circular mode) and the RXNE interrupt is replaced by the IDLE line,
+ * half transfer and transfer complete interrupts, so there is one interrupt
+ * per burst (or per half of storage) instead of one per byte.
+ *
+ * The callback is called from these interrupts with each new chunk of bytes,
+ * in place in storage (two calls if the chunk wraps the end of storage). The
+ * bytes must be used (or copied) before the DMA writes over them, i.e. before
+ * half of storage more is received.
+ *
+ * The USART and DMA interrupts of the port must have the same priority.
+ * */
+uart_status_e Uart_Config_RX_DMA(USART_TypeDef *UARTx, uint8_t *storage, uint16_t size, Uart_RX_Chunk_CallbackFunc_t callback);
+
 #endif /* UART_H_ */